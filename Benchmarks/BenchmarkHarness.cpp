@@ -0,0 +1,159 @@
+#include "BenchmarkHarness.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+BenchmarkState::BenchmarkState(long long arg, unsigned long long iterations)
+{
+	_arg = arg;
+	_iterations = iterations;
+	_remaining = iterations;
+	_started = false;
+	_paused = false;
+	_elapsed = Clock::duration::zero();
+	_itemsProcessed = 0;
+}
+
+bool BenchmarkState::KeepRunning()
+{
+	if (!_started)
+	{
+		_started = true;
+		_start = Clock::now();
+	}
+
+	if (_remaining > 0 && _error.empty())
+	{
+		--_remaining;
+		return true;
+	}
+
+	if (!_paused)
+		_elapsed += Clock::now() - _start;
+	_paused = true;
+	return false;
+}
+
+long long BenchmarkState::arg() { return _arg; }
+
+void BenchmarkState::PauseTiming()
+{
+	if (_paused)
+		return;
+	_elapsed += Clock::now() - _start;
+	_paused = true;
+}
+
+void BenchmarkState::ResumeTiming()
+{
+	if (!_paused)
+		return;
+	_start = Clock::now();
+	_paused = false;
+}
+
+void BenchmarkState::SetItemsProcessed(unsigned long long items) { _itemsProcessed = items; }
+void BenchmarkState::SkipWithError(const char* message) { _error = message; }
+
+unsigned long long BenchmarkState::iterations() { return _iterations; }
+double BenchmarkState::seconds() { return std::chrono::duration<double>(_elapsed).count(); }
+unsigned long long BenchmarkState::itemsProcessed() { return _itemsProcessed; }
+const std::string& BenchmarkState::error() { return _error; }
+
+std::vector<BenchmarkRegistry::Entry>& BenchmarkRegistry::entries()
+{
+	// Function local so registrations from other translation units never run before it is constructed
+	static std::vector<Entry> registered;
+	return registered;
+}
+
+int BenchmarkRegistry::Register(const char* name, BenchmarkFunction function, std::initializer_list<long long> args)
+{
+	Entry entry;
+	entry.name = name;
+	entry.function = function;
+	entry.args.assign(args.begin(), args.end());
+	if (entry.args.empty())
+		entry.args.push_back(0);
+	entries().push_back(entry);
+	return (int)entries().size();
+}
+
+int BenchmarkRegistry::RunAll(int argc, char** argv)
+{
+	const char* filter = "";
+	double minTime = 0.5;
+	const char* jsonPath = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--filter=", 9) == 0)
+			filter = argv[i] + 9;
+		else if (strncmp(argv[i], "--min_time=", 11) == 0)
+			minTime = atof(argv[i] + 11);
+		else if (strncmp(argv[i], "--json=", 7) == 0)
+			jsonPath = argv[i] + 7;
+	}
+
+	std::ofstream json;
+	if (jsonPath)
+	{
+		json.open(jsonPath);
+		json << "{\"benchmarks\": [" << std::endl;
+	}
+	bool firstResult = true;
+	int failures = 0;
+
+	printf("%-48s %15s %12s %15s\n", "Benchmark", "Time/iter (ns)", "Iterations", "Items/s");
+	printf("------------------------------------------------------------------------------------------\n");
+
+	std::vector<Entry>& all = entries();
+	for (unsigned int i = 0; i < all.size(); ++i)
+	{
+		Entry& entry = all[i];
+		for (unsigned int j = 0; j < entry.args.size(); ++j)
+		{
+			char name[256];
+			snprintf(name, sizeof(name), "%s/%lld", entry.name.c_str(), entry.args[j]);
+			if (!strstr(name, filter))
+				continue;
+
+			// Grow the iteration count until one run is long enough to trust, aiming straight for the minimum time once it is measurable
+			unsigned long long iterations = 1;
+			while (true)
+			{
+				BenchmarkState state(entry.args[j], iterations);
+				entry.function(state);
+
+				if (!state.error().empty())
+				{
+					printf("%-48s ERROR: %s\n", name, state.error().c_str());
+					++failures;
+					break;
+				}
+
+				double seconds = state.seconds();
+				if (seconds >= minTime || iterations >= 1000000000ull)
+				{
+					double nsPerIteration = seconds * 1.0e9 / iterations;
+					double itemsPerSecond = seconds > 0.0 ? state.itemsProcessed() / seconds : 0.0;
+					printf("%-48s %15.0f %12llu %15.4g\n", name, nsPerIteration, iterations, itemsPerSecond);
+					if (jsonPath)
+					{
+						json << (firstResult ? "" : ",\n") << "  {\"name\": \"" << name << "\", \"iterations\": " << iterations
+							<< ", \"nsPerIteration\": " << nsPerIteration << ", \"itemsPerSecond\": " << itemsPerSecond << "}";
+						firstResult = false;
+					}
+					break;
+				}
+
+				unsigned long long next = seconds > minTime / 100.0 ? (unsigned long long)(iterations * minTime * 1.4 / seconds) : iterations * 10;
+				iterations = next > iterations ? next : iterations + 1;
+			}
+		}
+	}
+
+	if (jsonPath)
+		json << "\n]}" << std::endl;
+	return failures;
+}
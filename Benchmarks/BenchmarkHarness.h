@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// A small benchmark runner modelled on Google Benchmark. Register a function with BENCHMARK and time its body with
+//	while (state.KeepRunning()) { ... }
+// Each function is run once per argument, with the iteration count grown until a run lasts at least the minimum time.
+class BenchmarkState
+{
+public:
+	BenchmarkState(long long arg, unsigned long long iterations);
+
+	bool KeepRunning();
+
+	// The argument the benchmark was registered with, usually the scene size
+	long long arg();
+
+	// Stops the clock for setup work that should not count, such as resetting state between iterations
+	void PauseTiming();
+	void ResumeTiming();
+
+	// Reported as a rate alongside the time per iteration
+	void SetItemsProcessed(unsigned long long items);
+	void SkipWithError(const char* message);
+
+	unsigned long long iterations();
+	double seconds();
+	unsigned long long itemsProcessed();
+	const std::string& error();
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	long long _arg;
+	unsigned long long _iterations;
+	unsigned long long _remaining;
+	bool _started;
+	bool _paused;
+	Clock::time_point _start;
+	Clock::duration _elapsed;
+	unsigned long long _itemsProcessed;
+	std::string _error;
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkState& state);
+
+class BenchmarkRegistry
+{
+public:
+	static int Register(const char* name, BenchmarkFunction function, std::initializer_list<long long> args);
+
+	// Accepts --filter=<substring>, --min_time=<seconds> and --json=<file>, returns non-zero if any benchmark failed
+	static int RunAll(int argc, char** argv);
+private:
+	struct Entry
+	{
+		std::string name;
+		BenchmarkFunction function;
+		std::vector<long long> args;
+	};
+
+	static std::vector<Entry>& entries();
+};
+
+#define BENCHMARK_CONCAT_INNER(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_INNER(a, b)
+// BENCHMARK(function, arg0, arg1, ...) registers function to be run once for each argument, with no arguments it runs once with 0
+#define BENCHMARK(function, ...) static int BENCHMARK_CONCAT(benchmarkRegistration, __LINE__) = BenchmarkRegistry::Register(#function, function, { __VA_ARGS__ })
@@ -0,0 +1,366 @@
+#include "BenchmarkHarness.h"
+#include <GLEW\glew.h>
+#include <GLM\gtc\quaternion.hpp>
+#include <cmath>
+#include <cstdio>
+
+#include "AnimationManager.h"
+#include "B-Spline.h"
+#include "CameraManager.h"
+#include "FramePacket.h"
+#include "Init_Shader.h"
+#include "LightingManager.h"
+#include "RenderManager.h"
+#include "TransformManager.h"
+
+// Every benchmark builds its own scene and tears it down again, so they can run in any order
+static Shader BenchmarkShader()
+{
+	Shader shader = Shader();
+	shader.shaderPointer = 1;
+	return shader;
+}
+
+static void ClearScene()
+{
+	AnimationManager::DumpData();
+	LightingManager::DumpData();
+	RenderManager::DumpData();
+	TransformManager::DumpData();
+}
+
+static void SetPatch(B_Spline& spline, int patch, float offset)
+{
+	glm::vec3 p[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		p[i] = glm::vec3((float)(i % 4), std::sin(offset + i), (float)(i / 4));
+	}
+	spline.SetControlPoints(patch, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+}
+
+// Rebuilds the surface of every patch, the argument is the number of patches. Surface resolution is the compile time Patch::NUM_VERTS.
+static void BM_PatchUpdateSurface(BenchmarkState& state)
+{
+	int numPatches = (int)state.arg();
+	B_Spline* spline = new B_Spline(BenchmarkShader(), numPatches);
+	FramePacket packet;
+
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		for (int i = 0; i < numPatches; ++i)
+		{
+			SetPatch(*spline, i, 0.0f);
+		}
+		state.ResumeTiming();
+
+		spline->Update(0.0f);
+
+		// Hand the queued vertex uploads to a packet so they do not pile up
+		state.PauseTiming();
+		RenderManager::BuildFrame(packet);
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed(state.iterations() * numPatches);
+
+	delete spline;
+	ClearScene();
+}
+BENCHMARK(BM_PatchUpdateSurface, 1, 28, 280);
+
+static void BM_BSplineSetControlPoints(BenchmarkState& state)
+{
+	int numPatches = (int)state.arg();
+	B_Spline* spline = new B_Spline(BenchmarkShader(), numPatches);
+
+	while (state.KeepRunning())
+	{
+		for (int i = 0; i < numPatches; ++i)
+		{
+			SetPatch(*spline, i, 1.0f);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * numPatches);
+
+	delete spline;
+	ClearScene();
+}
+BENCHMARK(BM_BSplineSetControlPoints, 1, 28, 280);
+
+// Shape updates plus composing every moving transform's model matrix, the argument is the number of shapes
+static void BM_RenderShapeUpdate(BenchmarkState& state)
+{
+	int numShapes = (int)state.arg();
+	for (int i = 0; i < numShapes; ++i)
+	{
+		ShapeHandle shape = RenderManager::CreateShape(1, 36, GL_TRIANGLES, BenchmarkShader(), glm::vec4(1.0f));
+		Transform transform = RenderManager::GetShape(shape)->transform();
+		transform.position(glm::vec3((float)i, 0.0f, 0.0f));
+		transform.angularVelocity(glm::angleAxis(30.0f, glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+
+	while (state.KeepRunning())
+	{
+		RenderManager::Update(1.0f / 60.0f);
+		TransformManager::Update(1.0f / 60.0f);
+	}
+	state.SetItemsProcessed(state.iterations() * numShapes);
+
+	ClearScene();
+}
+BENCHMARK(BM_RenderShapeUpdate, 100, 1000, 10000, 100000);
+
+// Gathering, sorting and batching every shape into a frame packet, the argument is the number of shapes
+static void BM_RenderManagerBuildFrame(BenchmarkState& state)
+{
+	int numShapes = (int)state.arg();
+	for (int i = 0; i < numShapes; ++i)
+	{
+		RenderManager::CreateShape(1 + i % 4, 36, GL_TRIANGLES, BenchmarkShader(), glm::vec4(1.0f));
+	}
+	TransformManager::Update(0.0f);
+	TransformManager::Interpolate(1.0f);
+	FramePacket packet;
+
+	while (state.KeepRunning())
+	{
+		RenderManager::BuildFrame(packet);
+	}
+	state.SetItemsProcessed(state.iterations() * numShapes);
+
+	ClearScene();
+}
+BENCHMARK(BM_RenderManagerBuildFrame, 100, 1000, 10000);
+
+// The same with every shape bounded and shading level of detail on, shapes stretch away from the camera so some of them are lit
+// per vertex and some per pixel
+static void BM_RenderManagerBuildFrameShadingLod(BenchmarkState& state)
+{
+	int numShapes = (int)state.arg();
+	for (int i = 0; i < numShapes; ++i)
+	{
+		RenderShape* shape = RenderManager::GetShape(RenderManager::CreateShape(1 + i % 4, 36, GL_TRIANGLES, BenchmarkShader(), glm::vec4(1.0f)));
+		shape->bounds() = glm::vec4(0.0f, 0.0f, 0.0f, 0.5f);
+		shape->transform().position(glm::vec3((float)(i % 10) - 4.5f, 0.0f, (float)(i / 10) * 0.5f));
+	}
+	TransformManager::Update(0.0f);
+	TransformManager::Interpolate(1.0f);
+	CameraManager::Init(800.0f / 600.0f, 60.0f, 0.1f, 100.0f);
+	CameraManager::Update(0.0f);
+	RenderManager::SetShadingLod(48.0f, 600);
+	FramePacket packet;
+
+	while (state.KeepRunning())
+	{
+		RenderManager::BuildFrame(packet);
+	}
+	state.SetItemsProcessed(state.iterations() * numShapes);
+
+	RenderManager::SetShadingLod(0.0f, 600);
+	ClearScene();
+}
+BENCHMARK(BM_RenderManagerBuildFrameShadingLod, 100, 1000, 10000);
+
+// The argument is the number of lights, each with a gizmo shape
+static void BM_LightingManagerUpdate(BenchmarkState& state)
+{
+	int numLights = (int)state.arg();
+	LightingManager::Init();
+	for (int i = 0; i < numLights; ++i)
+	{
+		LightHandle handle = LightingManager::AddLight();
+		Light* light = LightingManager::GetLight(handle);
+		if (!light)
+		{
+			state.SkipWithError("more lights than LightingManager supports");
+			break;
+		}
+		light->angularVelocity = glm::angleAxis(30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+		light->rotationOrigin = glm::vec3(-3.0f, 1.5f, 0.0f);
+		light->position = glm::vec3(3.0f, (float)i, 0.0f);
+		light->color = glm::vec4(1.0f);
+		light->power = 5.0f;
+		LightingManager::SetLightShape(RenderManager::CreateShape(1, 36, GL_TRIANGLES, BenchmarkShader(), glm::vec4(1.0f)), handle);
+	}
+
+	while (state.KeepRunning())
+	{
+		LightingManager::Update(1.0f / 60.0f);
+	}
+	state.SetItemsProcessed(state.iterations() * numLights);
+
+	ClearScene();
+}
+BENCHMARK(BM_LightingManagerUpdate, 1, 3, 8, 1000);
+
+// Sampling keyframed tracks and writing them to their targets, the argument is the number of transforms,
+// each with an 8 key position track and an 8 key rotation track
+static void BM_AnimationManagerUpdate(BenchmarkState& state)
+{
+	int numTransforms = (int)state.arg();
+	Keyframe positions[8];
+	Keyframe rotations[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::quat rotation = glm::angleAxis(45.0f * i, glm::vec3(0.0f, 1.0f, 0.0f));
+		positions[i].time = rotations[i].time = 0.5f * i;
+		positions[i].value = glm::vec4(std::cos(0.8f * i), std::sin(0.8f * i), 0.0f, 0.0f);
+		rotations[i].value = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	}
+	for (int i = 0; i < numTransforms; ++i)
+	{
+		Transform transform = TransformManager::Create();
+		AnimationManager::AddTrack(transform, CHANNEL_POSITION, positions, 8);
+		AnimationManager::AddTrack(transform, CHANNEL_ROTATION, rotations, 8);
+	}
+
+	while (state.KeepRunning())
+	{
+		AnimationManager::Update(1.0f / 60.0f);
+	}
+	state.SetItemsProcessed(state.iterations() * numTransforms);
+
+	ClearScene();
+}
+BENCHMARK(BM_AnimationManagerUpdate, 100, 1000, 10000);
+
+// Scatters the argument's number of lights around the origin with a short reach
+static void ScatterLights(int numLights)
+{
+	LightingManager::Init();
+	for (int i = 0; i < numLights; ++i)
+	{
+		Light* light = LightingManager::GetLight(LightingManager::AddLight());
+		float angle = i * 2.4f;
+		light->position = glm::vec3(std::cos(angle) * (1.0f + i % 7), (float)(i % 5) - 2.0f, std::sin(angle) * (1.0f + i % 7));
+		light->color = glm::vec4(1.0f);
+		light->power = 0.3f;
+		light->radius = 1.5f;
+	}
+	LightingManager::Update(0.0f);
+}
+
+// Builds lighting frames into packet for as long as the benchmark runs, with the camera at eye looking at target. A moving camera
+// steps a tenth of a unit back and forth every frame so the clusters are rebuilt each time, a still one never rebuilds them
+static void BuildLightingFrames(BenchmarkState& state, FramePacket& packet, glm::vec3 eye, glm::vec3 target, bool moving)
+{
+	glm::vec3 step = moving ? glm::vec3(0.0f, 0.0f, 0.1f) : glm::vec3(0.0f);
+	glm::mat4 viewMats[] = {
+		glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)),
+		glm::lookAt(eye + step, target, glm::vec3(0.0f, 1.0f, 0.0f))
+	};
+	packet.projMat = glm::perspective(60.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+
+	unsigned int frame = 0;
+	while (state.KeepRunning())
+	{
+		packet.viewMat = viewMats[frame++ % 2];
+		LightingManager::BuildFrame(packet, 1.0f);
+	}
+}
+
+// Packing and binning lights into view clusters for a frame, the argument is the number of lights.
+// The camera alternates between two positions so the clusters are rebuilt every frame
+static void BM_LightingManagerBuildFrame(BenchmarkState& state)
+{
+	int numLights = (int)state.arg();
+	ScatterLights(numLights);
+
+	FramePacket packet;
+	BuildLightingFrames(state, packet, glm::vec3(0.0f, 2.0f, -8.0f), glm::vec3(0.0f), true);
+	state.SetItemsProcessed(state.iterations() * numLights);
+
+	ClearScene();
+}
+BENCHMARK(BM_LightingManagerBuildFrame, 8, 256, 4096);
+
+// The same with nothing moving, lights are only compared against the last frame and the clusters are left as they were
+static void BM_LightingManagerBuildFrameStatic(BenchmarkState& state)
+{
+	int numLights = (int)state.arg();
+	ScatterLights(numLights);
+
+	FramePacket packet;
+	BuildLightingFrames(state, packet, glm::vec3(0.0f, 2.0f, -8.0f), glm::vec3(0.0f), false);
+	state.SetItemsProcessed(state.iterations() * numLights);
+
+	ClearScene();
+}
+BENCHMARK(BM_LightingManagerBuildFrameStatic, 8, 256, 4096);
+
+// Cutting the light tree for the clusters, the argument is the number of lights spread over a field stretching away from the
+// camera, each reaching far enough that distant clusters see hundreds of them. The lights stand still so the tree is built once,
+// and the camera alternates between two positions so the cuts are redone every frame
+static void BM_LightingManagerLightCuts(BenchmarkState& state)
+{
+	int numLights = (int)state.arg();
+	LightingManager::Init();
+	LightingManager::SetLightCutError(0.25f);
+	for (int i = 0; i < numLights; ++i)
+	{
+		Light* light = LightingManager::GetLight(LightingManager::AddLight());
+		light->position = glm::vec3((float)(i % 64) - 32.0f, 0.5f, (float)(i / 64) * 1.5f);
+		light->color = glm::vec4(1.0f);
+		light->power = 0.3f;
+		light->radius = 8.0f;
+	}
+	LightingManager::Update(0.0f);
+
+	FramePacket packet;
+	BuildLightingFrames(state, packet, glm::vec3(0.0f, 4.0f, -8.0f), glm::vec3(0.0f, 0.0f, 20.0f), true);
+	state.SetItemsProcessed(state.iterations() * numLights);
+
+	LightingManager::SetLightCutError(0.0f);
+	ClearScene();
+}
+BENCHMARK(BM_LightingManagerLightCuts, 256, 4096);
+
+// Listing the lights reaching every shape, the argument is the number of shapes, each in reach of a few of 256 lights.
+// Nothing moves, so the time is spent in culling rather than in binning clusters
+static void BM_LightingManagerCullObjects(BenchmarkState& state)
+{
+	int numShapes = (int)state.arg();
+	ScatterLights(256);
+	for (int i = 0; i < numShapes; ++i)
+	{
+		RenderShape* shape = RenderManager::GetShape(RenderManager::CreateShape(1, 36, GL_TRIANGLES, BenchmarkShader(), glm::vec4(1.0f)));
+		shape->transform().position(glm::vec3((float)(i % 16) - 8.0f, 0.0f, (float)(i / 16 % 16) - 8.0f));
+		shape->bounds() = glm::vec4(0.0f, 0.0f, 0.0f, 0.5f);
+	}
+	TransformManager::Update(0.0f);
+	TransformManager::Interpolate(1.0f);
+
+	FramePacket packet;
+	RenderManager::BuildFrame(packet);
+	BuildLightingFrames(state, packet, glm::vec3(0.0f, 2.0f, -8.0f), glm::vec3(0.0f), false);
+	state.SetItemsProcessed(state.iterations() * numShapes);
+
+	ClearScene();
+}
+BENCHMARK(BM_LightingManagerCullObjects, 16, 256, 4096);
+
+// Reading both phong shader sources from disk and running them through initShaders, with compilation stubbed out
+static void BM_InitShaders(BenchmarkState& state)
+{
+	char* shaders[] = { "../Geometric_Lighting_Improved-GLFW/fShader.glsl", "../Geometric_Lighting_Improved-GLFW/vShader.glsl" };
+	GLenum types[] = { GL_FRAGMENT_SHADER, GL_VERTEX_SHADER };
+
+	for (int i = 0; i < 2; ++i)
+	{
+		FILE* file = fopen(shaders[i], "r");
+		if (!file)
+		{
+			state.SkipWithError("shader sources not found, run from the Benchmarks directory");
+			return;
+		}
+		fclose(file);
+	}
+
+	while (state.KeepRunning())
+	{
+		initShaders(shaders, types, 2);
+	}
+	state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_InitShaders);
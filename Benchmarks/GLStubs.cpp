@@ -0,0 +1,81 @@
+#include "GLStubs.h"
+#include <GLEW\glew.h>
+
+static GLuint nextName = 0;
+
+template <typename R, typename... Args>
+struct NullGL
+{
+	static R GLAPIENTRY Call(Args...) { return R(); }
+};
+
+template <typename R, typename... Args>
+static void Stub(R (GLAPIENTRY*& function)(Args...))
+{
+	function = &NullGL<R, Args...>::Call;
+}
+
+static void GLAPIENTRY StubGenNames(GLsizei n, GLuint* names)
+{
+	for (GLsizei i = 0; i < n; ++i)
+	{
+		names[i] = ++nextName;
+	}
+}
+
+static GLuint GLAPIENTRY StubCreate() { return ++nextName; }
+static GLuint GLAPIENTRY StubCreateShader(GLenum) { return ++nextName; }
+
+// Compile and link status read as success and info logs as empty
+static void GLAPIENTRY StubGetObjectiv(GLuint, GLenum pname, GLint* params)
+{
+	*params = (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+void InstallGLStubs()
+{
+	// glBufferSubData and friends are macros for GLEW's function pointers, so these assign the pointers themselves
+	glGenBuffers = StubGenNames;
+	glGenVertexArrays = StubGenNames;
+	glGenQueries = StubGenNames;
+	glGenFramebuffers = StubGenNames;
+	glGenRenderbuffers = StubGenNames;
+	glCreateProgram = StubCreate;
+	glCreateShader = StubCreateShader;
+	glGetShaderiv = StubGetObjectiv;
+	glGetProgramiv = StubGetObjectiv;
+
+	Stub(glBindBuffer);
+	Stub(glBindBufferBase);
+	Stub(glBufferData);
+	Stub(glBufferSubData);
+	Stub(glDeleteBuffers);
+	Stub(glBindVertexArray);
+	Stub(glDeleteVertexArrays);
+	Stub(glGetAttribLocation);
+	Stub(glVertexAttribPointer);
+	Stub(glEnableVertexAttribArray);
+
+	Stub(glShaderSource);
+	Stub(glCompileShader);
+	Stub(glGetShaderInfoLog);
+	Stub(glAttachShader);
+	Stub(glDetachShader);
+	Stub(glDeleteShader);
+	Stub(glBindFragDataLocation);
+	Stub(glLinkProgram);
+	Stub(glGetProgramInfoLog);
+	Stub(glDeleteProgram);
+	Stub(glUseProgram);
+	Stub(glGetUniformLocation);
+	Stub(glUniform1i);
+	Stub(glUniform4fv);
+	Stub(glUniformMatrix4fv);
+
+	Stub(glMultiDrawElementsIndirect);
+	Stub(glBeginQuery);
+	Stub(glEndQuery);
+	Stub(glGetQueryObjectiv);
+	Stub(glGetQueryObjectui64v);
+	Stub(glDeleteQueries);
+}
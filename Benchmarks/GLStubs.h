@@ -0,0 +1,5 @@
+#pragma once
+
+// Points every GL entry point the engine uses at functions that do nothing, so engine code runs without a context or GPU.
+// Object names are handed out in sequence and status queries report success, everything else returns zero.
+void InstallGLStubs();
@@ -0,0 +1,25 @@
+/*
+*	Micro-benchmarks for the engine's CPU hot paths. GL calls are stubbed out, so this runs on machines without a GPU.
+*	Run from this directory so shader sources are found:
+*		Benchmarks.exe [--filter=<substring>] [--min_time=<seconds>] [--json=<file>]
+*/
+#include <thread>
+#include "BenchmarkHarness.h"
+#include "GLStubs.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+int main(int argc, char** argv)
+{
+	InstallGLStubs();
+
+	unsigned int numCores = std::thread::hardware_concurrency();
+	WorkerPool::Init(numCores > 1 ? numCores - 1 : 0);
+
+	int failures = BenchmarkRegistry::RunAll(argc, argv);
+
+	WorkerPool::Shutdown();
+	Profiler::Shutdown();
+
+	return failures;
+}
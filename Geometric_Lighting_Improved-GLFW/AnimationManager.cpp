@@ -0,0 +1,167 @@
+#include "AnimationManager.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+TrackedVector<float, MEM_ANIMATION> AnimationManager::_keyTimes;
+TrackedVector<glm::vec4, MEM_ANIMATION> AnimationManager::_keyValues;
+
+TrackedVector<AnimationManager::Track, MEM_ANIMATION> AnimationManager::_tracks;
+TrackedVector<AnimationManager::Target, MEM_ANIMATION> AnimationManager::_targets;
+TrackedVector<glm::vec4, MEM_ANIMATION> AnimationManager::_samples;
+
+bool AnimationManager::AddTrack(Transform target, AnimationChannel channel, const Keyframe* keys, unsigned int numKeys, bool loop)
+{
+	if (channel == CHANNEL_COLOR)
+		return false;
+
+	Target track;
+	track.channel = channel;
+	track.transform = target;
+	return AddTrack(track, keys, numKeys, loop);
+}
+
+bool AnimationManager::AddTrack(LightHandle target, AnimationChannel channel, const Keyframe* keys, unsigned int numKeys, bool loop)
+{
+	if (channel == CHANNEL_SCALE)
+		return false;
+
+	Target track;
+	track.channel = channel;
+	track.light = target;
+	return AddTrack(track, keys, numKeys, loop);
+}
+
+bool AnimationManager::AddTrack(const Target& target, const Keyframe* keys, unsigned int numKeys, bool loop)
+{
+	if (numKeys == 0)
+		return false;
+
+	Track track;
+	track.firstKey = _keyTimes.size();
+	track.numKeys = numKeys;
+	track.cursor = 0;
+	track.time = 0.0f;
+	track.loop = loop;
+
+	for (unsigned int i = 0; i < numKeys; ++i)
+	{
+		glm::vec4 value = keys[i].value;
+
+		// Rotations are blended linearly and renormalized, which only takes the short way round when neighbouring keys
+		// are in the same hemisphere, so each key is flipped to match the one before it
+		if (target.channel == CHANNEL_ROTATION && i > 0 && glm::dot(value, _keyValues.back()) < 0.0f)
+			value = -value;
+
+		_keyTimes.push_back(keys[i].time);
+		_keyValues.push_back(value);
+	}
+
+	_tracks.push_back(track);
+	_targets.push_back(target);
+	_samples.push_back(keys[0].value);
+	return true;
+}
+
+void AnimationManager::Update(float dt)
+{
+	PROFILE_ZONE("AnimationManager::Update");
+
+	unsigned int numTracks = _tracks.size();
+	WorkerPool::ParallelFor(numTracks, MIN_PARALLEL_BATCH, [dt](unsigned int begin, unsigned int end)
+	{
+		Sample(begin, end, dt);
+	});
+
+	// Targets are written on one thread, several tracks can share a transform or light
+	for (unsigned int i = 0; i < numTracks; ++i)
+	{
+		const Target& target = _targets[i];
+		const glm::vec4& sample = _samples[i];
+		glm::vec3 vector = glm::vec3(sample.x, sample.y, sample.z);
+
+		if (target.light.valid())
+		{
+			Light* light = LightingManager::GetLight(target.light);
+			if (!light)
+				continue;
+
+			switch (target.channel)
+			{
+			case CHANNEL_POSITION:
+				light->position = vector;
+				break;
+			case CHANNEL_ROTATION:
+				light->rotation = glm::normalize(glm::quat(sample.w, sample.x, sample.y, sample.z));
+				break;
+			default:
+				light->color = sample;
+				break;
+			}
+		}
+		else
+		{
+			Transform transform = target.transform;
+			switch (target.channel)
+			{
+			case CHANNEL_POSITION:
+				transform.position(vector);
+				break;
+			case CHANNEL_ROTATION:
+				transform.rotation(glm::normalize(glm::quat(sample.w, sample.x, sample.y, sample.z)));
+				break;
+			default:
+				transform.scale(vector);
+				break;
+			}
+		}
+	}
+}
+
+void AnimationManager::Sample(unsigned int begin, unsigned int end, float dt)
+{
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		Track& track = _tracks[i];
+		const float* times = &_keyTimes[track.firstKey];
+		const glm::vec4* values = &_keyValues[track.firstKey];
+		unsigned int lastKey = track.numKeys - 1;
+
+		track.time += dt;
+		float duration = times[lastKey];
+		if (track.time >= duration)
+		{
+			if (track.loop && duration > 0.0f)
+			{
+				track.time = std::fmod(track.time, duration);
+				track.cursor = 0;
+			}
+			else
+			{
+				track.time = duration;
+			}
+		}
+
+		while (track.cursor + 1 < lastKey && times[track.cursor + 1] <= track.time)
+			++track.cursor;
+
+		unsigned int next = std::min(track.cursor + 1, lastKey);
+		float span = times[next] - times[track.cursor];
+		float t = span > 0.0f ? std::min(std::max((track.time - times[track.cursor]) / span, 0.0f), 1.0f) : 0.0f;
+
+		__m128 a = _mm_loadu_ps(&values[track.cursor].x);
+		__m128 b = _mm_loadu_ps(&values[next].x);
+		_mm_storeu_ps(&_samples[i].x, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t))));
+	}
+}
+
+void AnimationManager::DumpData()
+{
+	ReleaseVector(_keyTimes);
+	ReleaseVector(_keyValues);
+	ReleaseVector(_tracks);
+	ReleaseVector(_targets);
+	ReleaseVector(_samples);
+}
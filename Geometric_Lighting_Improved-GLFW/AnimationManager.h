@@ -0,0 +1,66 @@
+#pragma once
+#include <GLM\gtc\quaternion.hpp>
+#include "LightingManager.h"
+#include "TransformManager.h"
+#include "MemoryTracker.h"
+
+// The value a track animates. Rotations are quaternions stored as x, y, z, w, positions and scales leave w unused
+enum AnimationChannel
+{
+	CHANNEL_POSITION,
+	CHANNEL_ROTATION,
+	CHANNEL_SCALE,
+	CHANNEL_COLOR
+};
+
+struct Keyframe
+{
+	float time;
+	glm::vec4 value;
+};
+
+// Keyframed tracks driving transforms and lights. The keys of every track sit back to back in shared arrays, and each step
+// every track is sampled in one batch, split across the WorkerPool's threads for large counts, interpolating all four components
+// of a sample at once with SSE. The samples are then written to their targets in a single pass.
+class AnimationManager
+{
+public:
+	// Keys must be in order of time, the track starts at time 0 and holds its last key or, when looping, wraps around to time 0.
+	// Returns false when the channel does not apply to the target, lights have no scale and transforms no color
+	static bool AddTrack(Transform target, AnimationChannel channel, const Keyframe* keys, unsigned int numKeys, bool loop = true);
+	static bool AddTrack(LightHandle target, AnimationChannel channel, const Keyframe* keys, unsigned int numKeys, bool loop = true);
+	// Advances every track by dt and writes the samples to their targets, called before the systems reading them are updated
+	static void Update(float dt);
+	static void DumpData();
+private:
+	struct Track
+	{
+		unsigned int firstKey;
+		unsigned int numKeys;
+		// Key the last sample came after, samples move forward so the next search starts from it
+		unsigned int cursor;
+		float time;
+		bool loop;
+	};
+
+	struct Target
+	{
+		AnimationChannel channel;
+		// Exactly one of the two is valid
+		Transform transform;
+		LightHandle light;
+	};
+
+	static bool AddTrack(const Target& target, const Keyframe* keys, unsigned int numKeys, bool loop);
+	static void Sample(unsigned int begin, unsigned int end, float dt);
+
+	// Tracks smaller than this are not worth waking the worker threads for
+	static const unsigned int MIN_PARALLEL_BATCH = 4096;
+
+	static TrackedVector<float, MEM_ANIMATION> _keyTimes;
+	static TrackedVector<glm::vec4, MEM_ANIMATION> _keyValues;
+
+	static TrackedVector<Track, MEM_ANIMATION> _tracks;
+	static TrackedVector<Target, MEM_ANIMATION> _targets;
+	static TrackedVector<glm::vec4, MEM_ANIMATION> _samples;
+};
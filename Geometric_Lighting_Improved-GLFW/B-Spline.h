@@ -1,10 +1,10 @@
 #pragma once
 #include "RenderShape.h"
+#include "Patch.h"
+#include "Pool.h"
 
 #include <vector>
 
-class Patch;
-class RenderShape;
 
 class B_Spline
 {
@@ -19,9 +19,10 @@ public:
 		glm::vec3 controlPointPos8, glm::vec3 controlPointPos9, glm::vec3 controlPointPos10, glm::vec3 controlPointPos11,
 		glm::vec3 controlPointPos12, glm::vec3 controlPointPos13, glm::vec3 controlPointPos14, glm::vec3 controlPointPos15);
 
-	Transform& transform(); 
+	Transform transform();
 private:
 	Transform _transform;
 
-	std::vector<Patch*>* _spline;
+	Pool<Patch, MEM_PATCHES> _patches;
+	std::vector<PatchHandle> _spline;
 };
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "Benchmark.h"
+#include "CameraManager.h"
+#include "DeferredRenderer.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "LightingManager.h"
+#include "MemoryTracker.h"
+#include "ShadowManager.h"
+#include "VisibilityRenderer.h"
+#include <GLM\gtc\constants.hpp>
+#include <iostream>
+#include <string>
+
+bool Benchmark::_active = false;
+unsigned int Benchmark::_numFrames = 0;
+unsigned int Benchmark::_frame = 0;
+int Benchmark::_width = 0;
+int Benchmark::_height = 0;
+
+GLuint Benchmark::_framebuffer = 0;
+GLuint Benchmark::_colorBuffer = 0;
+GLuint Benchmark::_depthBuffer = 0;
+
+std::chrono::high_resolution_clock::time_point Benchmark::_startTime;
+std::chrono::high_resolution_clock::time_point Benchmark::_endTime;
+
+RenderStats Benchmark::_totals = RenderStats();
+
+static void WritePercentiles(std::ostream& out, FrameHistogram& histogram)
+{
+	out << "{\"p50\": " << histogram.Percentile(0.5f) << ", \"p95\": " << histogram.Percentile(0.95f) << ", \"p99\": " << histogram.Percentile(0.99f) << "}";
+}
+
+static std::string JsonString(const GLubyte* text)
+{
+	std::string escaped = "\"";
+	for (const char* c = (const char*)text; c && *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+			escaped += '\\';
+		escaped += *c;
+	}
+	return escaped + "\"";
+}
+
+GLFWwindow* Benchmark::CreateHiddenWindow(int width, int height, const char* title)
+{
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+	// EGL lets drivers such as Mesa's llvmpipe create a context without a display, fall back to the native API when unavailable
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	GLFWwindow* window = glfwCreateWindow(width, height, title, NULL, NULL);
+	if (!window)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+		window = glfwCreateWindow(width, height, title, NULL, NULL);
+	}
+	return window;
+}
+
+void Benchmark::Init(unsigned int numFrames, int width, int height)
+{
+	_active = true;
+	_numFrames = numFrames;
+	_frame = 0;
+	_width = width;
+	_height = height;
+
+	// A hidden window's default framebuffer may never be rendered to, so draw into one of our own
+	glGenRenderbuffers(1, &_colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, _colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	MemoryTracker::TrackGL(GL_RENDERBUFFER, _colorBuffer, width * height * 4, "benchmark framebuffer");
+
+	glGenRenderbuffers(1, &_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	MemoryTracker::TrackGL(GL_RENDERBUFFER, _depthBuffer, width * height * 4, "benchmark framebuffer");
+
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Benchmark framebuffer is incomplete" << std::endl;
+
+	glViewport(0, 0, width, height);
+	LightingManager::SetViewport(width, height);
+	DeferredRenderer::SetTarget(_framebuffer);
+	VisibilityRenderer::SetTarget(_framebuffer);
+	ShadowManager::SetTarget(_framebuffer, width, height);
+
+	// Run unthrottled, and keep the stats for the whole run instead of logging them periodically
+	FramePacer::SetSwapInterval(0);
+	FramePacer::SetMaxFps(0.0f);
+	FramePacer::SetLogInterval(0);
+	GpuProfiler::SetLogInterval(0);
+	RenderManager::SetLogInterval(0);
+}
+
+void Benchmark::Shutdown()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &_framebuffer);
+	MemoryTracker::UntrackGL(GL_RENDERBUFFER, _colorBuffer);
+	MemoryTracker::UntrackGL(GL_RENDERBUFFER, _depthBuffer);
+	glDeleteRenderbuffers(1, &_colorBuffer);
+	glDeleteRenderbuffers(1, &_depthBuffer);
+	_framebuffer = _colorBuffer = _depthBuffer = 0;
+	_active = false;
+}
+
+bool Benchmark::active()
+{
+	return _active;
+}
+
+void Benchmark::ScriptCamera(unsigned int frame)
+{
+	// One full orbit over the measured frames while bobbing up and down twice
+	float t = (float)frame / (float)(WARMUP_FRAMES + _numFrames);
+	CameraManager::SetOrientation(360.0f * t, 30.0f * glm::sin(t * 4.0f * glm::pi<float>()));
+}
+
+void Benchmark::EndFrame(const RenderStats& stats)
+{
+	++_frame;
+	if (_frame == WARMUP_FRAMES)
+	{
+		FramePacer::ResetStats();
+		GpuProfiler::ResetStats();
+		_startTime = std::chrono::high_resolution_clock::now();
+		return;
+	}
+	if (_frame < WARMUP_FRAMES)
+		return;
+
+	_totals += stats;
+
+	if (finished())
+		_endTime = std::chrono::high_resolution_clock::now();
+}
+
+bool Benchmark::finished()
+{
+	return _frame >= WARMUP_FRAMES + _numFrames;
+}
+
+void Benchmark::WriteReport(std::ostream& out)
+{
+	unsigned int measured = _frame > WARMUP_FRAMES ? _frame - WARMUP_FRAMES : 0;
+	double seconds = std::chrono::duration<double>(_endTime - _startTime).count();
+	double frames = measured ? (double)measured : 1.0;
+
+	out << "{" << std::endl;
+	out << "  \"frames\": " << measured << "," << std::endl;
+	out << "  \"warmupFrames\": " << WARMUP_FRAMES << "," << std::endl;
+	out << "  \"width\": " << _width << "," << std::endl;
+	out << "  \"height\": " << _height << "," << std::endl;
+	out << "  \"renderer\": " << JsonString(glGetString(GL_RENDERER)) << "," << std::endl;
+	out << "  \"glVersion\": " << JsonString(glGetString(GL_VERSION)) << "," << std::endl;
+	out << "  \"wallTimeSeconds\": " << seconds << "," << std::endl;
+	out << "  \"averageFps\": " << (seconds > 0.0 ? measured / seconds : 0.0) << "," << std::endl;
+	out << "  \"frameTimeMs\": "; WritePercentiles(out, FramePacer::frameTimes()); out << "," << std::endl;
+	out << "  \"cpuTimeMs\": "; WritePercentiles(out, FramePacer::cpuTimes()); out << "," << std::endl;
+	out << "  \"swapTimeMs\": "; WritePercentiles(out, FramePacer::swapTimes()); out << "," << std::endl;
+	out << "  \"gpuPassMs\": "; GpuProfiler::WriteJson(out); out << "," << std::endl;
+	out << "  \"drawCallsPerFrame\": " << _totals.drawCalls / frames << "," << std::endl;
+	out << "  \"drawsPerFrame\": " << _totals.draws / frames << "," << std::endl;
+	out << "  \"trianglesPerFrame\": " << _totals.triangles / frames << "," << std::endl;
+	out << "  \"programBindsPerFrame\": " << _totals.programBinds / frames << "," << std::endl;
+	out << "  \"vaoBindsPerFrame\": " << _totals.vaoBinds / frames << "," << std::endl;
+	out << "  \"uniformUploadsPerFrame\": " << _totals.uniformUploads / frames << "," << std::endl;
+	out << "  \"bufferUploadsPerFrame\": " << _totals.bufferUploads / frames << "," << std::endl;
+	out << "  \"bytesUploadedPerFrame\": " << _totals.bytesUploaded / frames << "," << std::endl;
+	out << "  \"patchesRetessellatedPerFrame\": " << _totals.patchesRetessellated / frames << std::endl;
+	out << "}" << std::endl;
+}
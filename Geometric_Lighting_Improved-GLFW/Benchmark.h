@@ -0,0 +1,48 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLFW\glfw3.h>
+#include <chrono>
+#include <ostream>
+#include "RenderManager.h"
+
+// Drives repeatable performance runs: renders a fixed number of frames into an offscreen framebuffer
+// along a scripted camera path, then reports frame time percentiles and draw counts as JSON.
+class Benchmark
+{
+public:
+	// Creates a context that never shows on screen, an EGL one where GLFW supports it, returns nullptr on failure
+	static GLFWwindow* CreateHiddenWindow(int width, int height, const char* title);
+
+	// Call with the context current, builds the offscreen framebuffer and leaves it bound
+	static void Init(unsigned int numFrames, int width, int height);
+	static void Shutdown();
+	static bool active();
+
+	// Simulation thread, places the camera for the given simulation frame
+	static void ScriptCamera(unsigned int frame);
+
+	// Render thread, after each frame has been presented
+	static void EndFrame(const RenderStats& stats);
+	static bool finished();
+
+	static void WriteReport(std::ostream& out);
+private:
+	// Frames rendered before measuring starts, so shader compilation and first uploads are left out
+	static const unsigned int WARMUP_FRAMES = 30;
+
+	static bool _active;
+	static unsigned int _numFrames;
+	static unsigned int _frame;
+	static int _width;
+	static int _height;
+
+	static GLuint _framebuffer;
+	static GLuint _colorBuffer;
+	static GLuint _depthBuffer;
+
+	static std::chrono::high_resolution_clock::time_point _startTime;
+	static std::chrono::high_resolution_clock::time_point _endTime;
+
+	// Sum of the render stats of every measured frame
+	static RenderStats _totals;
+};
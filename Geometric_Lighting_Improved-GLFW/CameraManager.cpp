@@ -1,5 +1,6 @@
 #include "CameraManager.h"
 #include "InputManager.h"
+#include "Profiler.h"
 
 glm::mat4 CameraManager::_proj;
 glm::mat4 CameraManager::_view;
@@ -14,6 +15,8 @@ void CameraManager::Init(float aspectRatio, float fov, float near, float far)
 
 void CameraManager::Update(float dt)
 {
+	PROFILE_ZONE("CameraManager::Update");
+
 	float rotRate = 180.0f;
 	if (InputManager::cursorLocked())
 	{
@@ -36,6 +39,11 @@ void CameraManager::Update(float dt)
 	_view = glm::lookAt(glm::vec3(_camPos), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 }
 
+void CameraManager::SetOrientation(float bearing, float elevation)
+{
+	_position = glm::vec2(bearing, elevation);
+}
+
 glm::mat4 CameraManager::ProjMat()
 {
 	return _proj;
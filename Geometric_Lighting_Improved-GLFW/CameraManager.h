@@ -8,6 +8,8 @@ class CameraManager
 public:
 	static void Init(float aspectRatio, float fov, float near, float far);
 	static void Update(float dt);
+	// Points the camera at the origin from the given bearing and elevation in degrees, used for scripted camera paths
+	static void SetOrientation(float bearing, float elevation);
 	static glm::mat4 ViewMat();
 	static glm::mat4 ProjMat();
 	static glm::vec4 CamPos();
@@ -0,0 +1,255 @@
+#include "DeferredRenderer.h"
+#include "RenderManager.h"
+#include "FramePacket.h"
+#include "Init_Shader.h"
+#include "GpuProfiler.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <GLM\gtc\type_ptr.hpp>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+int DeferredRenderer::_width = 0;
+int DeferredRenderer::_height = 0;
+GLuint DeferredRenderer::_target = 0;
+
+GLuint DeferredRenderer::_gBuffer = 0;
+GLuint DeferredRenderer::_albedoTexture = 0;
+GLuint DeferredRenderer::_normalTexture = 0;
+GLuint DeferredRenderer::_depthTexture = 0;
+
+Shader DeferredRenderer::_geometryShader;
+
+GLuint DeferredRenderer::_ambientProgram = 0;
+
+GLuint DeferredRenderer::_lightProgram = 0;
+GLint DeferredRenderer::_uViewProjMat;
+GLint DeferredRenderer::_uInvViewProjMat;
+GLint DeferredRenderer::_uCamPos;
+GLint DeferredRenderer::_uInvViewport;
+
+GLuint DeferredRenderer::_sphereVao = 0;
+GLuint DeferredRenderer::_sphereVbo = 0;
+GLuint DeferredRenderer::_sphereEbo = 0;
+GLsizei DeferredRenderer::_sphereElements = 0;
+
+void DeferredRenderer::Init(int width, int height)
+{
+	_width = width;
+	_height = height;
+
+	char* geometryShaders[] = { "vShader.glsl", "gbuffer_frag.glsl" };
+	GLenum geometryTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_geometryShader.shaderPointer = initShaders(geometryShaders, geometryTypes, 2);
+	_geometryShader.uCamPos = -1;
+	_geometryShader.uDrawOffset = glGetUniformLocation(_geometryShader.shaderPointer, "drawOffset");
+
+	char* ambientShaders[] = { "fullscreen_vert.glsl", "deferred_ambient_frag.glsl" };
+	GLenum ambientTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_ambientProgram = initShaders(ambientShaders, ambientTypes, 2);
+
+	char* lightShaders[] = { "light_volume_vert.glsl", "light_volume_frag.glsl" };
+	GLenum lightTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_lightProgram = initShaders(lightShaders, lightTypes, 2);
+	_uViewProjMat = glGetUniformLocation(_lightProgram, "viewProjMat");
+	_uInvViewProjMat = glGetUniformLocation(_lightProgram, "invViewProjMat");
+	_uCamPos = glGetUniformLocation(_lightProgram, "camPos");
+	_uInvViewport = glGetUniformLocation(_lightProgram, "invViewport");
+
+	// Normals are kept at half precision, they are not normalized before lighting in the forward shader either
+	_albedoTexture = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4);
+	_normalTexture = CreateTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8);
+	// Matches the depth format of the window and benchmark framebuffers so it can be blitted into them
+	_depthTexture = CreateTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4);
+
+	glGenFramebuffers(1, &_gBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _gBuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _depthTexture, 0);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "G-buffer is incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, _target);
+
+	CreateSphere();
+}
+
+void DeferredRenderer::SetTarget(GLuint framebuffer)
+{
+	_target = framebuffer;
+}
+
+GLuint DeferredRenderer::CreateTexture(GLenum internalFormat, GLenum format, GLenum type, size_t bytesPerPixel)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height, 0, format, type, NULL);
+	// Only ever read a texel at a time, but without mipmaps the default filter would leave the texture incomplete
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	MemoryTracker::TrackGL(GL_TEXTURE, texture, bytesPerPixel * _width * _height, "g-buffer");
+	return texture;
+}
+
+void DeferredRenderer::CreateSphere()
+{
+	// A latitude-longitude sphere of unit radius, pushed out so its flat faces never cut inside the true sphere
+	const float pi = 3.14159265f;
+	float scale = 1.0f / (std::cos(pi / SPHERE_SLICES) * std::cos(pi / (2.0f * SPHERE_STACKS)));
+
+	std::vector<GLfloat> verts;
+	for (unsigned int i = 0; i <= SPHERE_STACKS; ++i)
+	{
+		float theta = pi * i / SPHERE_STACKS;
+		for (unsigned int j = 0; j <= SPHERE_SLICES; ++j)
+		{
+			float phi = 2.0f * pi * j / SPHERE_SLICES;
+			verts.push_back(scale * std::sin(theta) * std::cos(phi));
+			verts.push_back(scale * std::cos(theta));
+			verts.push_back(scale * std::sin(theta) * std::sin(phi));
+		}
+	}
+
+	// Wound counter-clockwise seen from outside
+	std::vector<GLuint> elements;
+	for (unsigned int i = 0; i < SPHERE_STACKS; ++i)
+	{
+		for (unsigned int j = 0; j < SPHERE_SLICES; ++j)
+		{
+			GLuint a = i * (SPHERE_SLICES + 1) + j;
+			GLuint b = a + SPHERE_SLICES + 1;
+			elements.push_back(a);
+			elements.push_back(b + 1);
+			elements.push_back(b);
+			elements.push_back(a);
+			elements.push_back(a + 1);
+			elements.push_back(b + 1);
+		}
+	}
+	_sphereElements = elements.size();
+
+	glGenVertexArrays(1, &_sphereVao);
+	glBindVertexArray(_sphereVao);
+
+	glGenBuffers(1, &_sphereVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, _sphereVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * verts.size(), &verts[0], GL_STATIC_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _sphereVbo, sizeof(GLfloat) * verts.size(), "light volumes");
+
+	glGenBuffers(1, &_sphereEbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _sphereEbo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * elements.size(), &elements[0], GL_STATIC_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _sphereEbo, sizeof(GLuint) * elements.size(), "light volumes");
+
+	// Position is bound to location 0 in light_volume_vert.glsl
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+	glBindVertexArray(0);
+}
+
+void DeferredRenderer::DrawOpaque(const FramePacket& packet)
+{
+	PROFILE_ZONE("DeferredRenderer::DrawOpaque");
+
+	GpuProfiler::BeginPass("g-buffer clear");
+	glBindFramebuffer(GL_FRAMEBUFFER, _gBuffer);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GpuProfiler::EndPass();
+
+	RenderManager::DrawPass(packet, PASS_OPAQUE, &_geometryShader);
+
+	GpuProfiler::BeginPass("deferred lighting");
+
+	// The target takes the scene's depth, light volumes are tested against it and forward passes drawn afterwards are hidden by it
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _gBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _target);
+	glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, _target);
+
+	glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
+	glBindTexture(GL_TEXTURE_2D, _albedoTexture);
+	glActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
+	glBindTexture(GL_TEXTURE_2D, _normalTexture);
+	glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+	glBindTexture(GL_TEXTURE_2D, _depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// Ambient light covers every pixel and overwrites the target, empty pixels have no albedo and come out black
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(_ambientProgram);
+	glBindVertexArray(RenderManager::emptyVao());
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	RenderManager::RecordStateChanges(1, 0);
+	RenderManager::RecordDrawCall(1, 1);
+
+	// Only the back faces of each volume are drawn, so a light still shades while the camera is inside it. A back face in front
+	// of the surface behind it means the surface lies beyond the sphere, GL_GEQUAL rejects those pixels before they are shaded.
+	// Depth clamping keeps back faces past the far plane, which would otherwise leave surfaces near it unlit.
+	unsigned int numLights = packet.lights.size();
+	if (numLights > 0)
+	{
+		glm::mat4 viewProjMat = packet.projMat * packet.viewMat;
+		glm::mat4 invViewProjMat = glm::inverse(viewProjMat);
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_DEPTH_CLAMP);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+
+		glUseProgram(_lightProgram);
+		glUniformMatrix4fv(_uViewProjMat, 1, GL_FALSE, glm::value_ptr(viewProjMat));
+		glUniformMatrix4fv(_uInvViewProjMat, 1, GL_FALSE, glm::value_ptr(invViewProjMat));
+		glUniform4fv(_uCamPos, 1, glm::value_ptr(packet.camPos));
+		glUniform2f(_uInvViewport, 1.0f / _width, 1.0f / _height);
+		glBindVertexArray(_sphereVao);
+		glDrawElementsInstanced(GL_TRIANGLES, _sphereElements, GL_UNSIGNED_INT, 0, numLights);
+		RenderManager::RecordStateChanges(1, 4);
+		RenderManager::RecordDrawCall(numLights, (unsigned long long)numLights * (_sphereElements / 3));
+
+		glDisable(GL_BLEND);
+		glCullFace(GL_BACK);
+		glDisable(GL_CULL_FACE);
+		glDisable(GL_DEPTH_CLAMP);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+	glEnable(GL_DEPTH_TEST);
+
+	GpuProfiler::EndPass();
+}
+
+void DeferredRenderer::DumpData()
+{
+	glDeleteProgram(_geometryShader.shaderPointer);
+	glDeleteProgram(_ambientProgram);
+	glDeleteProgram(_lightProgram);
+	_geometryShader.shaderPointer = 0;
+	_ambientProgram = _lightProgram = 0;
+
+	glDeleteFramebuffers(1, &_gBuffer);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _albedoTexture);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _normalTexture);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _depthTexture);
+	glDeleteTextures(1, &_albedoTexture);
+	glDeleteTextures(1, &_normalTexture);
+	glDeleteTextures(1, &_depthTexture);
+	_gBuffer = _albedoTexture = _normalTexture = _depthTexture = 0;
+
+	MemoryTracker::UntrackGL(GL_BUFFER, _sphereVbo);
+	MemoryTracker::UntrackGL(GL_BUFFER, _sphereEbo);
+	glDeleteBuffers(1, &_sphereVbo);
+	glDeleteBuffers(1, &_sphereEbo);
+	glDeleteVertexArrays(1, &_sphereVao);
+	_sphereVbo = _sphereEbo = _sphereVao = 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLM\glm.hpp>
+#include "RenderShape.h"
+
+struct FramePacket;
+
+// Deferred shading for the opaque pass. Opaque shapes write their albedo, normal and depth into a G-buffer, then every light
+// is drawn as a sphere of its radius that only shades the pixels inside it, adding its contribution to the target framebuffer.
+// The cost of lighting follows the pixels each light covers instead of every light for every fragment drawn.
+class DeferredRenderer
+{
+public:
+	// The G-buffer is created at the given size, which must match the target framebuffer
+	static void Init(int width, int height);
+	// Framebuffer the lit scene is written to, 0 for the window's
+	static void SetTarget(GLuint framebuffer);
+	// Render thread, fills the G-buffer from the packet's opaque pass and lights it into the target. The target is left bound
+	// holding the scene's depth, so later forward passes are hidden behind it.
+	// LightingManager::Apply and RenderManager::Upload must have run for the packet first
+	static void DrawOpaque(const FramePacket& packet);
+	static void DumpData();
+
+	// Texture units the G-buffer is read from, must match the bindings in the deferred lighting shaders
+	static const GLuint ALBEDO_UNIT = 0;
+	static const GLuint NORMAL_UNIT = 1;
+	static const GLuint DEPTH_UNIT = 2;
+private:
+	static void CreateSphere();
+	static GLuint CreateTexture(GLenum internalFormat, GLenum format, GLenum type, size_t bytesPerPixel);
+
+	static const unsigned int SPHERE_SLICES = 16;
+	static const unsigned int SPHERE_STACKS = 8;
+
+	static int _width;
+	static int _height;
+	static GLuint _target;
+
+	static GLuint _gBuffer;
+	static GLuint _albedoTexture;
+	static GLuint _normalTexture;
+	static GLuint _depthTexture;
+
+	// Writes the opaque shapes into the G-buffer, reads the same vertices and per-draw buffer as the forward shader
+	static Shader _geometryShader;
+
+	static GLuint _ambientProgram;
+
+	static GLuint _lightProgram;
+	static GLint _uViewProjMat;
+	static GLint _uInvViewProjMat;
+	static GLint _uCamPos;
+	static GLint _uInvViewport;
+
+	static GLuint _sphereVao;
+	static GLuint _sphereVbo;
+	static GLuint _sphereEbo;
+	static GLsizei _sphereElements;
+};
@@ -0,0 +1,186 @@
+#ifdef _WIN32
+// Used to raise the system timer resolution to 1ms so short sleeps are not rounded up to a 15.6ms tick
+#include <Windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+#include "FramePacer.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+const float FrameHistogram::BUCKET_WIDTH = 0.05f;
+
+FrameHistogram::FrameHistogram()
+{
+	Reset();
+}
+
+void FrameHistogram::Record(float milliseconds)
+{
+	float bucket = milliseconds > 0.0f ? milliseconds / BUCKET_WIDTH : 0.0f;
+	if (bucket < NUM_BUCKETS)
+		++_buckets[(unsigned int)bucket];
+	else
+		_slowest.push_back(milliseconds);
+	++_count;
+}
+
+float FrameHistogram::Percentile(float fraction)
+{
+	if (_count == 0)
+		return 0.0f;
+
+	unsigned int target = (unsigned int)(fraction * (_count - 1)) + 1;
+	unsigned int seen = 0;
+	for (unsigned int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		seen += _buckets[i];
+		if (seen >= target)
+			return (i + 1) * BUCKET_WIDTH;
+	}
+
+	std::vector<float>::iterator sample = _slowest.begin() + (target - seen - 1);
+	std::nth_element(_slowest.begin(), sample, _slowest.end());
+	return *sample;
+}
+
+unsigned int FrameHistogram::count() { return _count; }
+
+void FrameHistogram::Reset()
+{
+	for (unsigned int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		_buckets[i] = 0;
+	}
+	_slowest.clear();
+	_count = 0;
+}
+
+const std::chrono::microseconds FramePacer::SPIN_TIME = std::chrono::microseconds(2000);
+
+GLFWwindow* FramePacer::_window = nullptr;
+unsigned int FramePacer::_logInterval = 600;
+std::chrono::nanoseconds FramePacer::_targetFrameTime = std::chrono::nanoseconds(0);
+
+FramePacer::Clock::time_point FramePacer::_frameStart;
+FramePacer::Clock::time_point FramePacer::_lastFrameEnd;
+FramePacer::Clock::time_point FramePacer::_nextDeadline;
+
+FrameHistogram FramePacer::_cpuTimes;
+FrameHistogram FramePacer::_swapTimes;
+FrameHistogram FramePacer::_frameTimes;
+
+static float Milliseconds(std::chrono::high_resolution_clock::duration duration)
+{
+	return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+void FramePacer::Init(GLFWwindow* window, int swapInterval, float maxFps)
+{
+	_window = window;
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif
+	SetSwapInterval(swapInterval);
+	SetMaxFps(maxFps);
+
+	_frameStart = Clock::now();
+	_lastFrameEnd = _frameStart;
+	_nextDeadline = _frameStart;
+}
+
+void FramePacer::Shutdown()
+{
+	if (_logInterval)
+		LogStats();
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::SetSwapInterval(int swapInterval)
+{
+	// Must be called from the thread that owns the context
+	glfwSwapInterval(swapInterval);
+}
+
+void FramePacer::SetMaxFps(float maxFps)
+{
+	_targetFrameTime = maxFps > 0.0f ? std::chrono::nanoseconds((long long)(1.0e9 / maxFps)) : std::chrono::nanoseconds(0);
+	_nextDeadline = Clock::now();
+}
+
+void FramePacer::BeginFrame()
+{
+	_frameStart = Clock::now();
+}
+
+void FramePacer::Present()
+{
+	Clock::time_point swapStart = Clock::now();
+	glfwSwapBuffers(_window);
+	Clock::time_point swapEnd = Clock::now();
+
+	if (_targetFrameTime.count() > 0)
+	{
+		// Deadlines advance by whole frames so they do not drift, unless the frame is so late that it would cause a burst of catch-up frames
+		_nextDeadline += _targetFrameTime;
+		if (_nextDeadline < swapEnd)
+			_nextDeadline = swapEnd;
+		WaitUntil(_nextDeadline);
+	}
+	Clock::time_point frameEnd = Clock::now();
+
+	_cpuTimes.Record(Milliseconds(swapStart - _frameStart));
+	_swapTimes.Record(Milliseconds(swapEnd - swapStart));
+	_frameTimes.Record(Milliseconds(frameEnd - _lastFrameEnd));
+	_lastFrameEnd = frameEnd;
+
+	if (_logInterval && _frameTimes.count() >= _logInterval)
+	{
+		LogStats();
+		ResetStats();
+	}
+}
+
+FrameHistogram& FramePacer::cpuTimes() { return _cpuTimes; }
+FrameHistogram& FramePacer::swapTimes() { return _swapTimes; }
+FrameHistogram& FramePacer::frameTimes() { return _frameTimes; }
+
+void FramePacer::SetLogInterval(unsigned int frames)
+{
+	_logInterval = frames;
+}
+
+void FramePacer::LogStats()
+{
+	if (_frameTimes.count() == 0)
+		return;
+
+	std::cout << "Frame times over " << _frameTimes.count() << " frames (ms)  p50 / p95 / p99" << std::endl;
+	std::cout << "  cpu   " << _cpuTimes.Percentile(0.5f) << " / " << _cpuTimes.Percentile(0.95f) << " / " << _cpuTimes.Percentile(0.99f) << std::endl;
+	std::cout << "  swap  " << _swapTimes.Percentile(0.5f) << " / " << _swapTimes.Percentile(0.95f) << " / " << _swapTimes.Percentile(0.99f) << std::endl;
+	std::cout << "  total " << _frameTimes.Percentile(0.5f) << " / " << _frameTimes.Percentile(0.95f) << " / " << _frameTimes.Percentile(0.99f) << std::endl;
+}
+
+void FramePacer::ResetStats()
+{
+	_cpuTimes.Reset();
+	_swapTimes.Reset();
+	_frameTimes.Reset();
+}
+
+void FramePacer::WaitUntil(Clock::time_point target)
+{
+	// Sleep through most of the wait, then spin for the remainder to land on the deadline
+	Clock::time_point now = Clock::now();
+	while (target - now > SPIN_TIME)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		now = Clock::now();
+	}
+	while (Clock::now() < target)
+	{
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLFW\glfw3.h>
+#include <chrono>
+#include <vector>
+
+// Counts frame times into fixed-width buckets so percentiles can be read without keeping every sample. Only the rare frames
+// slower than the buckets reach are kept as they are
+class FrameHistogram
+{
+public:
+	FrameHistogram();
+
+	void Record(float milliseconds);
+	// Upper edge of the bucket holding the given fraction of samples, 0.5f for the median, or the sample itself past the buckets
+	float Percentile(float fraction);
+	unsigned int count();
+	void Reset();
+private:
+	static const unsigned int NUM_BUCKETS = 2000;
+	static const float BUCKET_WIDTH;
+
+	unsigned int _buckets[NUM_BUCKETS];
+	// Samples past the end of the range
+	std::vector<float> _slowest;
+	unsigned int _count;
+};
+
+// Sets the swap interval, optionally caps the frame rate, and measures every frame the render thread presents
+class FramePacer
+{
+public:
+	// A maxFps of 0 leaves the frame rate uncapped
+	static void Init(GLFWwindow* window, int swapInterval, float maxFps);
+	static void Shutdown();
+
+	static void SetSwapInterval(int swapInterval);
+	static void SetMaxFps(float maxFps);
+
+	// Call when work on a frame starts, then Present in place of glfwSwapBuffers
+	static void BeginFrame();
+	static void Present();
+
+	// CPU time from BeginFrame to the swap, time spent in the swap itself, and time between the end of consecutive frames
+	static FrameHistogram& cpuTimes();
+	static FrameHistogram& swapTimes();
+	static FrameHistogram& frameTimes();
+
+	// Stats are logged and reset every this many frames, 0 turns periodic and shutdown logging off
+	static void SetLogInterval(unsigned int frames);
+	static void LogStats();
+	static void ResetStats();
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	static void WaitUntil(Clock::time_point target);
+
+	// Sleeping can overshoot by about a scheduler tick, so the last stretch before a deadline is spun instead
+	static const std::chrono::microseconds SPIN_TIME;
+	static GLFWwindow* _window;
+	static unsigned int _logInterval;
+	static std::chrono::nanoseconds _targetFrameTime;
+
+	static Clock::time_point _frameStart;
+	static Clock::time_point _lastFrameEnd;
+	static Clock::time_point _nextDeadline;
+
+	static FrameHistogram _cpuTimes;
+	static FrameHistogram _swapTimes;
+	static FrameHistogram _frameTimes;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLM\glm.hpp>
+#include "MemoryTracker.h"
+#include "RenderManager.h"
+#include "LightingManager.h"
+#include "ShadowManager.h"
+
+// Everything the render thread needs to draw one frame. The simulation thread fills a packet in and hands it over,
+// after which it is only read by the render thread until it is handed back to be reused.
+struct FramePacket
+{
+	glm::mat4 viewMat;
+	glm::mat4 projMat;
+	glm::vec4 camPos;
+
+	TrackedVector<DrawElementsIndirectCommand, MEM_FRAME_PACKETS> commands;
+	TrackedVector<DrawData, MEM_FRAME_PACKETS> drawData;
+	TrackedVector<DrawBatch, MEM_FRAME_PACKETS> batches;
+	// World space bounding sphere of every draw, a negative radius for shapes without bounds
+	TrackedVector<glm::vec4, MEM_FRAME_PACKETS> drawBounds;
+	// Bumped by the simulation whenever a static shadow caster moved, changed shape, appeared or went away
+	unsigned int staticCasterVersion;
+
+	TrackedVector<BufferUpload, MEM_FRAME_PACKETS> uploads;
+	TrackedVector<GLfloat, MEM_FRAME_PACKETS> uploadData;
+	unsigned int patchesRetessellated;
+
+	TrackedVector<GpuLight, MEM_FRAME_PACKETS> lights;
+	// Groups of lights clusters may shade as one when the light cut error is above 0, uploaded after lights.
+	// Only filled in when lightVersion changed
+	TrackedVector<GpuLight, MEM_FRAME_PACKETS> virtualLights;
+	// Offset into clusterLightIndices and number of lights for every cluster, only filled in when clusterVersion changed
+	TrackedVector<glm::uvec2, MEM_FRAME_PACKETS> clusters;
+	TrackedVector<GLuint, MEM_FRAME_PACKETS> clusterLightIndices;
+	// Lights reaching each draw's bounds, indexed by DrawData::lightRange and rebuilt every frame
+	TrackedVector<GLuint, MEM_FRAME_PACKETS> objectLightIndices;
+	GpuLightingParams lightingParams;
+	// Bumped by the simulation whenever the lights, or the clusters and parameters, differ from the previous packet's
+	unsigned int lightVersion;
+	unsigned int clusterVersion;
+
+	// One per shadowed light, in the order of their layers
+	TrackedVector<ShadowCube, MEM_FRAME_PACKETS> shadowCubes;
+
+	// The packet's versions only count up from 0, so the render thread marks what it has not used yet with this one
+	static const unsigned int NO_VERSION = ~0u;
+};
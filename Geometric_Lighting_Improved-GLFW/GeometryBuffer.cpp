@@ -0,0 +1,89 @@
+#include "GeometryBuffer.h"
+#include "RenderShape.h"
+#include "MemoryTracker.h"
+
+GeometryBuffer::GeometryBuffer(Shader shader, VertexFormat format, GLsizei maxVerts, GLsizei maxElements)
+{
+	_program = shader.shaderPointer;
+	_format = format;
+	_maxVerts = maxVerts;
+	_maxElements = maxElements;
+	_usedVerts = 0;
+	_usedElements = 0;
+
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+
+	glGenBuffers(1, &_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertexSize() * _maxVerts, NULL, GL_DYNAMIC_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _vbo, sizeof(GLfloat) * vertexSize() * _maxVerts, "geometry vertices");
+
+	glGenBuffers(1, &_ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * _maxElements, NULL, GL_DYNAMIC_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _ebo, sizeof(GLuint) * _maxElements, "geometry elements");
+
+	// Bind buffer data to shader values
+	GLsizei stride = vertexSize() * sizeof(GLfloat);
+
+	GLint posAttrib = glGetAttribLocation(_program, "position");
+	glEnableVertexAttribArray(posAttrib);
+	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, stride, 0);
+
+	if (_format == VERTEX_POSITION_NORMAL)
+	{
+		GLint normAttrib = glGetAttribLocation(_program, "normal");
+		glEnableVertexAttribArray(normAttrib);
+		glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+	}
+
+	glBindVertexArray(0);
+}
+GeometryBuffer::~GeometryBuffer()
+{
+	MemoryTracker::UntrackGL(GL_BUFFER, _vbo);
+	MemoryTracker::UntrackGL(GL_BUFFER, _ebo);
+	glDeleteBuffers(1, &_vbo);
+	glDeleteBuffers(1, &_ebo);
+	glDeleteVertexArrays(1, &_vao);
+}
+
+bool GeometryBuffer::Allocate(GLsizei numVerts, GLsizei numElements, GeometryRange& range)
+{
+	if (_usedVerts + numVerts > _maxVerts || _usedElements + numElements > _maxElements)
+		return false;
+
+	// Ranges are handed out linearly and only reclaimed when the whole buffer is destroyed
+	range.baseVertex = _usedVerts;
+	range.firstIndex = _usedElements;
+	range.numVerts = numVerts;
+	range.numElements = numElements;
+
+	_usedVerts += numVerts;
+	_usedElements += numElements;
+	return true;
+}
+
+void GeometryBuffer::UploadVerts(const GeometryRange& range, const GLfloat* verts)
+{
+	GLsizeiptr vertBytes = sizeof(GLfloat) * vertexSize();
+	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, vertBytes * range.baseVertex, vertBytes * range.numVerts, verts);
+}
+
+void GeometryBuffer::UploadElements(const GeometryRange& range, const GLuint* elements)
+{
+	// Element indices stay local to the range, the base vertex is applied at draw time
+	glBindVertexArray(_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * range.firstIndex, sizeof(GLuint) * range.numElements, elements);
+	glBindVertexArray(0);
+}
+
+GLuint GeometryBuffer::vao() { return _vao; }
+GLuint GeometryBuffer::vertexBuffer() { return _vbo; }
+GLuint GeometryBuffer::elementBuffer() { return _ebo; }
+GLint GeometryBuffer::program() { return _program; }
+VertexFormat GeometryBuffer::format() { return _format; }
+GLsizei GeometryBuffer::vertexSize() { return _format == VERTEX_POSITION_NORMAL ? 6 : 3; }
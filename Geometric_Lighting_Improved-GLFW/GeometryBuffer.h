@@ -0,0 +1,50 @@
+#pragma once
+#include <GLEW\glew.h>
+
+struct Shader;
+
+enum VertexFormat
+{
+	VERTEX_POSITION,
+	VERTEX_POSITION_NORMAL
+};
+
+struct GeometryRange
+{
+	GLint baseVertex;
+	GLuint firstIndex;
+	GLsizei numVerts;
+	GLsizei numElements;
+};
+
+// Shared vertex and element storage for every shape drawn with the same shader and vertex format.
+// Shapes are handed out sub-ranges of one VAO so they can be submitted together in a single multi-draw.
+class GeometryBuffer
+{
+public:
+	GeometryBuffer(Shader shader, VertexFormat format, GLsizei maxVerts, GLsizei maxElements);
+	~GeometryBuffer();
+
+	bool Allocate(GLsizei numVerts, GLsizei numElements, GeometryRange& range);
+	void UploadVerts(const GeometryRange& range, const GLfloat* verts);
+	void UploadElements(const GeometryRange& range, const GLuint* elements);
+
+	GLuint vao();
+	GLuint vertexBuffer();
+	GLuint elementBuffer();
+	GLint program();
+	VertexFormat format();
+	GLsizei vertexSize();
+private:
+	GLuint _vao;
+	GLuint _vbo;
+	GLuint _ebo;
+
+	GLint _program;
+	VertexFormat _format;
+
+	GLsizei _maxVerts;
+	GLsizei _maxElements;
+	GLsizei _usedVerts;
+	GLsizei _usedElements;
+};
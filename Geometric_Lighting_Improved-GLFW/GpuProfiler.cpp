@@ -0,0 +1,171 @@
+#include "GpuProfiler.h"
+#include <iostream>
+
+std::vector<GpuProfiler::Pass> GpuProfiler::_passes = std::vector<GpuProfiler::Pass>();
+unsigned int GpuProfiler::_frame = 0;
+unsigned int GpuProfiler::_framesSinceLog = 0;
+unsigned int GpuProfiler::_logInterval = 600;
+int GpuProfiler::_openPass = -1;
+
+void GpuProfiler::Init()
+{
+	_frame = 0;
+	_framesSinceLog = 0;
+	_openPass = -1;
+}
+
+void GpuProfiler::Shutdown()
+{
+	if (_logInterval)
+		LogStats();
+
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		glDeleteQueries(FRAME_LATENCY, _passes[i].queries);
+	}
+	_passes.clear();
+}
+
+void GpuProfiler::BeginFrame()
+{
+	++_frame;
+	unsigned int slot = _frame % FRAME_LATENCY;
+
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		Pass& pass = _passes[i];
+		if (!pass.issued[slot])
+			continue;
+
+		// Results should long be ready, if the GPU is that far behind the sample is dropped rather than waited for
+		GLint available = 0;
+		glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+			pass.lastMilliseconds = nanoseconds / 1.0e6f;
+			pass.totalMilliseconds += pass.lastMilliseconds;
+			++pass.samples;
+		}
+		else
+		{
+			++pass.dropped;
+		}
+		pass.issued[slot] = false;
+	}
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (_logInterval && ++_framesSinceLog >= _logInterval)
+	{
+		LogStats();
+		ResetStats();
+		_framesSinceLog = 0;
+	}
+}
+
+void GpuProfiler::BeginPass(const char* name)
+{
+	if (_openPass >= 0)
+		EndPass();
+
+	Pass* pass = FindPass(name);
+	if (!pass)
+	{
+		Pass newPass;
+		newPass.name = name;
+		glGenQueries(FRAME_LATENCY, newPass.queries);
+		for (unsigned int i = 0; i < FRAME_LATENCY; ++i)
+		{
+			newPass.issued[i] = false;
+		}
+		newPass.lastMilliseconds = 0.0f;
+		newPass.totalMilliseconds = 0.0;
+		newPass.samples = 0;
+		newPass.dropped = 0;
+		_passes.push_back(newPass);
+		pass = &_passes.back();
+	}
+
+	unsigned int slot = _frame % FRAME_LATENCY;
+	glBeginQuery(GL_TIME_ELAPSED, pass->queries[slot]);
+	pass->issued[slot] = true;
+	_openPass = pass - &_passes[0];
+}
+
+void GpuProfiler::EndPass()
+{
+	if (_openPass < 0)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	_openPass = -1;
+}
+
+float GpuProfiler::PassMilliseconds(const char* name)
+{
+	Pass* pass = FindPass(name);
+	return pass ? pass->lastMilliseconds : 0.0f;
+}
+
+void GpuProfiler::LogStats()
+{
+	if (_passes.empty())
+		return;
+
+	std::cout << "GPU pass times (ms, average)" << std::endl;
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		Pass& pass = _passes[i];
+		float average = pass.samples ? (float)(pass.totalMilliseconds / pass.samples) : 0.0f;
+		std::cout << "  " << pass.name << " " << average;
+		if (pass.dropped)
+			std::cout << " (" << pass.dropped << " samples not ready)";
+		std::cout << std::endl;
+	}
+}
+
+void GpuProfiler::SetLogInterval(unsigned int frames)
+{
+	_logInterval = frames;
+}
+
+void GpuProfiler::ResetStats()
+{
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		_passes[i].totalMilliseconds = 0.0;
+		_passes[i].samples = 0;
+		_passes[i].dropped = 0;
+	}
+}
+
+void GpuProfiler::WriteJson(std::ostream& out)
+{
+	out << "{";
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		Pass& pass = _passes[i];
+		float average = pass.samples ? (float)(pass.totalMilliseconds / pass.samples) : 0.0f;
+		out << (i ? ", " : "") << "\"" << pass.name << "\": " << average;
+	}
+	out << "}";
+}
+
+GpuProfiler::Pass* GpuProfiler::FindPass(const char* name)
+{
+	unsigned int numPasses = _passes.size();
+	for (unsigned int i = 0; i < numPasses; ++i)
+	{
+		if (_passes[i].name == name)
+			return &_passes[i];
+	}
+	return nullptr;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Times render passes on the GPU with GL_TIME_ELAPSED queries. Each pass owns a ring of query objects and results
+// are read FRAME_LATENCY frames after they were issued, by which point the GPU has finished them and reading never stalls.
+// Time elapsed queries cannot nest, so only one pass may be open at a time.
+class GpuProfiler
+{
+public:
+	static void Init();
+	static void Shutdown();
+
+	// Render thread only, BeginFrame collects the results of the frame whose queries are about to be reused
+	static void BeginFrame();
+	static void EndFrame();
+
+	static void BeginPass(const char* name);
+	static void EndPass();
+
+	// Most recent GPU time of the named pass in milliseconds, 0 for unknown passes
+	static float PassMilliseconds(const char* name);
+
+	// Averages are logged and reset every this many frames, 0 turns periodic and shutdown logging off
+	static void SetLogInterval(unsigned int frames);
+	static void LogStats();
+	static void ResetStats();
+	// Writes the average time of every pass as a JSON object of name to milliseconds
+	static void WriteJson(std::ostream& out);
+private:
+	static const unsigned int FRAME_LATENCY = 4;
+
+	struct Pass
+	{
+		std::string name;
+		GLuint queries[FRAME_LATENCY];
+		bool issued[FRAME_LATENCY];
+
+		float lastMilliseconds;
+		double totalMilliseconds;
+		unsigned int samples;
+		unsigned int dropped;
+	};
+
+	static Pass* FindPass(const char* name);
+
+	static std::vector<Pass> _passes;
+	static unsigned int _frame;
+	static unsigned int _framesSinceLog;
+	static unsigned int _logInterval;
+	static int _openPass;
+};
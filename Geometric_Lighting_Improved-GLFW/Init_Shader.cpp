@@ -1,40 +1,60 @@
 #include "init_shader.h"
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
-static char* textFileRead(char* fn)
+// Returns the whole file, or an empty string if it can't be read
+static std::string textFileRead(const char* fn)
 {
-	FILE* fp;
-	char* content = NULL;
-	errno_t err;
+	std::ifstream file(fn, std::ios::in | std::ios::binary);
+	if (!file)
+		return std::string();
 
-	int count = 0;
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
 
-	if (fn != NULL)
+// Replaces every #include "file" line with the contents of that file, found relative to the file including it, so lighting
+// code can be shared between shaders. Returns an empty string if any file can't be read
+static std::string preprocess(const char* fn)
+{
+	std::string source = textFileRead(fn);
+	std::string path(fn);
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::istringstream lines(source);
+	std::string line, result;
+	while (std::getline(lines, line))
 	{
-		err = fopen_s(&fp, fn, "rt");
-
-		if (fp != NULL)
+		size_t directive = line.find("#include");
+		if (directive != std::string::npos && line.find_first_not_of(" \t") == directive)
 		{
-			fseek(fp, 0, SEEK_END);
-			count = ftell(fp);
-			rewind(fp);
-
-			if (count > 0)
+			size_t open = line.find('"', directive);
+			size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+			std::string included = close == std::string::npos ? std::string() : preprocess((directory + line.substr(open + 1, close - open - 1)).c_str());
+			if (included.empty())
 			{
-				content = new char[count + 1];
-				count = fread(content, sizeof(char), count, fp);
-				content[count] = '\0';
+				std::cerr << fn << ": " << line << " could not be read" << std::endl;
+				return std::string();
 			}
-			err = fclose(fp);
+			result += included;
+			result += '\n';
+		}
+		else
+		{
+			result += line;
+			result += '\n';
 		}
 	}
-	return content;
+	return result;
 }
 
-GLuint initShaders(char** shaders, GLenum* types, int numShaders)
+GLuint initShaders(char** shaders, GLenum* types, int numShaders, const char* defines)
 {
 	GLuint program = glCreateProgram();
+	std::vector<GLuint> compiledShaders(numShaders);
 	//loop through the shaders passed in and initialize them
 	for(int i = 0; i < numShaders; i++)
 	{
@@ -44,11 +64,22 @@ GLuint initShaders(char** shaders, GLenum* types, int numShaders)
 		//get a shader handler
 		shader = glCreateShader(types[i]);
 		//read the shader from the source file
-		const char* shaderSource = textFileRead(shaders[i]);
-		//pass source to GL
+		std::string source = preprocess(shaders[i]);
+		if (source.empty())
+		{
+			std::cerr << shaders[i] << " could not be read" << std::endl;
+			exit( EXIT_FAILURE );
+		}
+		//#version has to stay the first line, defines go right after it
+		if (defines)
+		{
+			size_t version = source.find("#version");
+			size_t lineEnd = version == std::string::npos ? version : source.find('\n', version);
+			source.insert(lineEnd == std::string::npos ? 0 : lineEnd + 1, defines);
+		}
+		//pass source to GL, the string owns the text so nothing needs freeing
+		const char* shaderSource = source.c_str();
 		glShaderSource(shader, 1, &shaderSource, NULL);
-		//delete the memory from the source text
-		delete[] shaderSource;
 		//Compile shader
 		glCompileShader(shader);
 
@@ -69,12 +100,20 @@ GLuint initShaders(char** shaders, GLenum* types, int numShaders)
 		}
 
 		glAttachShader(program, shader);
+		compiledShaders[i] = shader;
 	}
 	//Tell the fragment shader which buffer to write to
 	glBindFragDataLocation(program, 0, "outColor");
 
 	glLinkProgram(program);
 
+	//The program keeps the linked binary, the shader objects are no longer needed
+	for (int i = 0; i < numShaders; i++)
+	{
+		glDetachShader(program, compiledShaders[i]);
+		glDeleteShader(compiledShaders[i]);
+	}
+
 	//Check linking errors
 	GLint  linked;
     glGetProgramiv( program, GL_LINK_STATUS, &linked );
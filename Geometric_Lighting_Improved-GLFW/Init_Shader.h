@@ -2,8 +2,7 @@
 
 #include <GLEW\glew.h>
 
-static char* textFileRead(char* fn);
-
-GLuint initShaders(char** shaders, GLenum* types, int numShaders);
+// defines, when given, is inserted into every shader straight after its #version line
+GLuint initShaders(char** shaders, GLenum* types, int numShaders, const char* defines = nullptr);
 
 
@@ -1,6 +1,10 @@
 #include "InputManager.h"
+#include "Profiler.h"
 
-double InputManager::_mousePos[2];
+InputManager::InputState InputManager::_polled = InputManager::InputState();
+std::mutex InputManager::_polledMutex;
+
+glm::vec2 InputManager::_mouseCoords = glm::vec2();
 
 bool InputManager::_cursorLocked = false;
 
@@ -30,6 +34,10 @@ bool InputManager::_prevCtrlKey = false;
 
 bool InputManager::_prevSpaceKey = false;
 bool InputManager::_spaceKey = false;
+bool InputManager::_prevPKey = false;
+bool InputManager::_pKey = false;
+bool InputManager::_prevMKey = false;
+bool InputManager::_mKey = false;
 
 GLFWwindow* InputManager::_window;
 float InputManager::_aspectRatio = 0.0f;
@@ -42,60 +50,116 @@ void InputManager::Init(GLFWwindow* window)
 	_aspectRatio = (float)_windowSize[0] / (float)_windowSize[1];
 }
 
-void InputManager::Update()
+void InputManager::Poll()
 {
-	_prevLeftMouseButton = _leftMouseButton;
-	_leftMouseButton = glfwGetMouseButton(_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
-	glfwGetCursorPos(_window, &_mousePos[0], &_mousePos[1]);
+	PROFILE_ZONE("InputManager::Poll");
+
+	std::lock_guard<std::mutex> lock(_polledMutex);
+
+	bool leftMouseButton = glfwGetMouseButton(_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	double mousePos[2];
+	glfwGetCursorPos(_window, &mousePos[0], &mousePos[1]);
 
-	bool insideWindow = _mousePos[0] > 0 && _mousePos[0] < _windowSize[0] && _mousePos[1] > 0 && _mousePos[1] < _windowSize[1];
-	if (_leftMouseButton && (insideWindow || _cursorLocked))
+	bool insideWindow = mousePos[0] > 0 && mousePos[0] < _windowSize[0] && mousePos[1] > 0 && mousePos[1] < _windowSize[1];
+	if (leftMouseButton && (insideWindow || _polled.cursorLocked))
 	{
 		glfwSetCursorPos(_window, _windowSize[0] / 2, _windowSize[1] / 2);
-		if (!_cursorLocked)
+		if (!_polled.cursorLocked)
 		{
-			glfwGetCursorPos(_window, &_mousePos[0], &_mousePos[1]);
-			_cursorLocked = true;
+			// The cursor was just recentered, so it starts out without any movement
+			_polled.mouseCoords = glm::vec2();
+			_polled.cursorLocked = true;
+		}
+		else
+		{
+			// While locked the coordinates are the movement away from the center, which adds up until the simulation takes it
+			_polled.mouseCoords += MouseCoords(mousePos[0], mousePos[1]);
 		}
 		glfwSetInputMode(_window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 	}
 	else
 	{
-		_cursorLocked = false;
+		_polled.mouseCoords = MouseCoords(mousePos[0], mousePos[1]);
+		_polled.cursorLocked = false;
 		glfwSetInputMode(_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 	}
+	_polled.leftMouseButton = leftMouseButton;
+
+	_polled.downKey = glfwGetKey(_window, GLFW_KEY_DOWN) == GLFW_PRESS;
+	_polled.upKey = glfwGetKey(_window, GLFW_KEY_UP) == GLFW_PRESS;
+	_polled.leftKey = glfwGetKey(_window, GLFW_KEY_LEFT) == GLFW_PRESS;
+	_polled.rightKey = glfwGetKey(_window, GLFW_KEY_RIGHT) == GLFW_PRESS;
+
+	_polled.wKey = glfwGetKey(_window, GLFW_KEY_W) == GLFW_PRESS;
+	_polled.aKey = glfwGetKey(_window, GLFW_KEY_A) == GLFW_PRESS;
+	_polled.sKey = glfwGetKey(_window, GLFW_KEY_S) == GLFW_PRESS;
+	_polled.dKey = glfwGetKey(_window, GLFW_KEY_D) == GLFW_PRESS;
+	_polled.shiftKey = glfwGetKey(_window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+	_polled.ctrlKey = glfwGetKey(_window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+
+	_polled.spaceKey = glfwGetKey(_window, GLFW_KEY_SPACE) == GLFW_PRESS;
+	_polled.pKey = glfwGetKey(_window, GLFW_KEY_P) == GLFW_PRESS;
+	_polled.mKey = glfwGetKey(_window, GLFW_KEY_M) == GLFW_PRESS;
+}
+
+void InputManager::Update()
+{
+	PROFILE_ZONE("InputManager::Update");
+
+	InputState polled;
+	{
+		std::lock_guard<std::mutex> lock(_polledMutex);
+		polled = _polled;
+		// Mouse movement is consumed once taken so it is not applied twice
+		if (_polled.cursorLocked)
+			_polled.mouseCoords = glm::vec2();
+	}
+
+	_mouseCoords = polled.mouseCoords;
+	_cursorLocked = polled.cursorLocked;
+	_prevLeftMouseButton = _leftMouseButton;
+	_leftMouseButton = polled.leftMouseButton;
 
 	_prevDownKey = _downKey;
-	_downKey = glfwGetKey(_window, GLFW_KEY_DOWN) == GLFW_PRESS;
+	_downKey = polled.downKey;
 	_prevUpKey = _upKey;
-	_upKey = glfwGetKey(_window, GLFW_KEY_UP) == GLFW_PRESS;
+	_upKey = polled.upKey;
 	_prevLeftKey = _leftKey;
-	_leftKey = glfwGetKey(_window, GLFW_KEY_LEFT) == GLFW_PRESS;
+	_leftKey = polled.leftKey;
 	_prevRightKey = _rightKey;
-	_rightKey = glfwGetKey(_window, GLFW_KEY_RIGHT) == GLFW_PRESS;
+	_rightKey = polled.rightKey;
 
 	_prevWKey = _wKey;
-	_wKey = glfwGetKey(_window, GLFW_KEY_W) == GLFW_PRESS;
+	_wKey = polled.wKey;
 	_prevAKey = _aKey;
-	_aKey = glfwGetKey(_window, GLFW_KEY_A) == GLFW_PRESS;
+	_aKey = polled.aKey;
 	_prevSKey = _sKey;
-	_sKey = glfwGetKey(_window, GLFW_KEY_S) == GLFW_PRESS;
+	_sKey = polled.sKey;
 	_prevDKey = _dKey;
-	_dKey = glfwGetKey(_window, GLFW_KEY_D) == GLFW_PRESS;
+	_dKey = polled.dKey;
 	_prevShiftKey = _shiftKey;
-	_shiftKey = glfwGetKey(_window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+	_shiftKey = polled.shiftKey;
 	_prevCtrlKey = _ctrlKey;
-	_ctrlKey = glfwGetKey(_window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+	_ctrlKey = polled.ctrlKey;
 
 	_prevSpaceKey = _spaceKey;
-	_spaceKey = glfwGetKey(_window, GLFW_KEY_SPACE) == GLFW_PRESS;
+	_spaceKey = polled.spaceKey;
+	_prevPKey = _pKey;
+	_pKey = polled.pKey;
+	_prevMKey = _mKey;
+	_mKey = polled.mKey;
 }
 
 glm::vec2 InputManager::GetMouseCoords()
+{
+	return _mouseCoords;
+}
+
+glm::vec2 InputManager::MouseCoords(double x, double y)
 {
 	glm::vec2 ret = glm::vec2();
-	ret.x = (((float)_mousePos[0] / (float)_windowSize[0]) * 2.0f - 1.0f) * _aspectRatio;
-	ret.y = -(((float)_mousePos[1] / (float)_windowSize[1]) * 2.0f - 1.0f);
+	ret.x = (((float)x / (float)_windowSize[0]) * 2.0f - 1.0f) * _aspectRatio;
+	ret.y = -(((float)y / (float)_windowSize[1]) * 2.0f - 1.0f);
 	return ret;
 }
 bool InputManager::leftMouseButton(bool prev) { if (prev) return _prevLeftMouseButton; else return _leftMouseButton; }
@@ -113,4 +177,6 @@ bool InputManager::dKey(bool prev) { if (prev) return _prevDKey; else return _dK
 bool InputManager::shiftKey(bool prev) { if (prev) return _prevShiftKey; else return _shiftKey; }
 bool InputManager::ctrlKey(bool prev) { if (prev) return _prevCtrlKey; else return _ctrlKey; }
 bool InputManager::spaceKey(bool prev) { if (prev) return _prevSpaceKey; else return _spaceKey; }
+bool InputManager::pKey(bool prev) { if (prev) return _prevPKey; else return _pKey; }
+bool InputManager::mKey(bool prev) { if (prev) return _prevMKey; else return _mKey; }
 
@@ -2,12 +2,18 @@
 #include <GLEW\glew.h>
 #include <GLFW\glfw3.h>
 #include <GLM\glm.hpp>
+#include <mutex>
 
+// GLFW input may only be read on the main thread, so the main thread polls it into a snapshot with Poll
+// and the simulation thread takes the latest snapshot with Update. Everything else reads the taken state.
 class InputManager
 {
 public:
 	static void Init(GLFWwindow* window);
 
+	// Main thread only, reads the window's input and handles locking the cursor
+	static void Poll();
+	// Simulation thread, advances the current and previous state to the latest poll
 	static void Update();
 
 	static glm::vec2 GetMouseCoords();
@@ -26,9 +32,38 @@ public:
 	static bool shiftKey(bool prev = false);
 	static bool ctrlKey(bool prev = false);
 	static bool spaceKey(bool prev = false);
+	static bool pKey(bool prev = false);
+	static bool mKey(bool prev = false);
 private:
+	struct InputState
+	{
+		glm::vec2 mouseCoords;
+		bool leftMouseButton;
+		bool cursorLocked;
 
-	static double _mousePos[2];
+		bool upKey;
+		bool downKey;
+		bool leftKey;
+		bool rightKey;
+
+		bool wKey;
+		bool aKey;
+		bool sKey;
+		bool dKey;
+		bool shiftKey;
+		bool ctrlKey;
+		bool spaceKey;
+		bool pKey;
+		bool mKey;
+	};
+
+	static glm::vec2 MouseCoords(double x, double y);
+
+	// Written by Poll and read by Update, guarded by _polledMutex
+	static InputState _polled;
+	static std::mutex _polledMutex;
+
+	static glm::vec2 _mouseCoords;
 	static bool _leftMouseButton;
 	static bool _prevLeftMouseButton;
 	static bool _cursorLocked;
@@ -57,6 +92,10 @@ private:
 
 	static bool _prevSpaceKey;
 	static bool _spaceKey;
+	static bool _prevPKey;
+	static bool _pKey;
+	static bool _prevMKey;
+	static bool _mKey;
 
 	static GLFWwindow* _window;
 	static float _aspectRatio;
@@ -1,88 +1,808 @@
 #include "LightingManager.h"
 #include "RenderManager.h"
+#include "FramePacket.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Init_Shader.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
 #include <string>
 
-Light LightingManager::_lights[MAX_LIGHTS];
-RenderShape* LightingManager::_lightShapes[MAX_LIGHTS];
+const float LightingManager::LIGHT_CUTOFF = 1.0f / 256.0f;
+const float LightingManager::TREE_REFIT_LIMIT = 1.5f;
+
+Pool<Light, MEM_LIGHTING> LightingManager::_lights;
+
+GLuint LightingManager::_lightBuffer = 0;
+GLuint LightingManager::_clusterBuffer = 0;
+GLuint LightingManager::_lightIndexBuffer = 0;
+GLuint LightingManager::_objectLightBuffer = 0;
+GLuint LightingManager::_paramsBuffer = 0;
 
-GLint LightingManager::_shader;
-GLuint LightingManager::_uLights;
 glm::vec4 LightingManager::_ambient;
-GLuint LightingManager::_uAmbient;
-
-void LightingManager::Init(Shader lightingShader)
-{
-	_shader = lightingShader.shaderPointer;
-	glUseProgram(_shader);
-	for (int i = 0; i < MAX_LIGHTS; ++i)
-	{
-		_lights[i] = Light();
-		_lights[i].position = glm::vec3();
-		_lights[i].linearVelocity = glm::vec3();
-		_lights[i].rotation = glm::quat();
-		_lights[i].rotationOrigin = glm::vec3();
-		_lights[i].angularVelocity = glm::quat();
-		_lights[i].transformPos = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-		_lights[i].color = glm::vec4();
-		_lights[i].power = 0.0f;
-
-		std::string currentLight = "lights[";
-		char numStringBuffer[32];
-		itoa(i, numStringBuffer, 10);
-		currentLight += numStringBuffer;
-		currentLight += "].";
-		std::string pos = "position";
-		std::string col = "color_difPower";
-		_lights[i].uPosition = glGetUniformLocation(_shader, (currentLight + pos).c_str());
-		_lights[i].uColor_difPower = glGetUniformLocation(_shader, (currentLight + col).c_str());
-	}	
-
-	_uAmbient = glGetUniformLocation(_shader, "ambient");
+glm::vec2 LightingManager::_viewport = glm::vec2(1.0f, 1.0f);
+bool LightingManager::_clustered = true;
+float LightingManager::_cutError = 0.0f;
+
+TrackedVector<GpuLight, MEM_LIGHTING> LightingManager::_builtLights;
+GpuLightingParams LightingManager::_builtParams;
+glm::mat4 LightingManager::_builtViewMat;
+glm::mat4 LightingManager::_builtProjMat;
+unsigned int LightingManager::_lightVersion = 0;
+unsigned int LightingManager::_clusterVersion = 0;
+float LightingManager::_builtCutError = 0.0f;
+TrackedVector<LightingManager::LightNode, MEM_LIGHTING> LightingManager::_tree;
+float LightingManager::_builtTreeExtent = 0.0f;
+
+unsigned int LightingManager::_uploadedLightVersion;
+unsigned int LightingManager::_uploadedClusterVersion;
+unsigned int LightingManager::_uploadedLights = 0;
+
+Shader LightingManager::_variants[MAX_SPECIALIZED_LIGHTS + 1];
+Shader LightingManager::_vertexLitVariants[MAX_SPECIALIZED_LIGHTS + 2];
+
+TrackedVector<LightingManager::ClusterBounds, MEM_LIGHTING> LightingManager::_bounds;
+TrackedVector<unsigned int, MEM_LIGHTING> LightingManager::_treeOrder;
+TrackedVector<glm::vec3, MEM_LIGHTING> LightingManager::_viewCenters;
+TrackedVector<GLuint, MEM_LIGHTING> LightingManager::_sliceIndices[CLUSTERS_Z];
+TrackedVector<GLuint, MEM_LIGHTING> LightingManager::_sliceBlockCuts[CLUSTERS_Z];
+
+void LightingManager::Init()
+{
+	glGenBuffers(1, &_lightBuffer);
+	glGenBuffers(1, &_clusterBuffer);
+	glGenBuffers(1, &_lightIndexBuffer);
+	glGenBuffers(1, &_objectLightBuffer);
+	glGenBuffers(1, &_paramsBuffer);
+
+	// The new buffers are empty, so the first frame is always uploaded, and a zero view matrix matches no camera so it is always binned
+	_uploadedLightVersion = _uploadedClusterVersion = FramePacket::NO_VERSION;
+	_builtViewMat = glm::mat4(0.0f);
+}
+
+void LightingManager::SetViewport(int width, int height)
+{
+	_viewport = glm::vec2((float)width, (float)height);
+}
+
+void LightingManager::SetClustered(bool clustered)
+{
+	_clustered = clustered;
 }
+
+void LightingManager::SetLightCutError(float ratio)
+{
+	_cutError = std::max(ratio, 0.0f);
+}
+
 void LightingManager::Update(float dt)
 {
-	glUseProgram(_shader);
-	for (int i = 0; i < MAX_LIGHTS; ++i)
+	PROFILE_ZONE("LightingManager::Update");
+
+	unsigned int numLights = _lights.Size();
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		Light& light = _lights[i];
+		light.prevTransformPos = light.transformPos;
+		light.position += light.linearVelocity * dt;
+		// Most lights either stand still or are driven by animation tracks, only spinning ones pay for the slerp
+		if (light.angularVelocity.w != 1.0f)
+			light.rotation = glm::slerp(light.rotation, light.rotation * light.angularVelocity, dt);
+
+		glm::mat4 translateMat = glm::translate(glm::mat4(), light.position);
+
+		glm::mat4 rotateOriginMat = glm::translate(glm::mat4(), light.rotationOrigin);
+		glm::mat4 rotateMat = rotateOriginMat * glm::mat4_cast(light.rotation) * glm::inverse(rotateOriginMat);
+
+		light.transformPos = translateMat * rotateMat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		RenderShape* shape = RenderManager::GetShape(light.shape);
+		if (shape)
+		{
+			shape->active() = light.power > 0.0f;
+			shape->transform().position(glm::vec3(light.transformPos));
+			shape->transform().scale(glm::vec3(0.1f, 0.1f, 0.1f));
+			shape->currentColor() = light.color;
+		}
+	}
+}
+void LightingManager::BuildFrame(FramePacket& packet, float alpha)
+{
+	PROFILE_ZONE("LightingManager::BuildFrame");
+
+	// Only lights that are on are packed, so shaders can visit every light they are given. They are compared against the last
+	// frame built as they are packed, the render thread only uploads them when they changed
+	unsigned int numLights = _lights.Size();
+	unsigned int numActive = 0;
+	unsigned int numShadowed = 0;
+	unsigned int numBuilt = _builtLights.size();
+	packet.lights.resize(numLights);
+	_builtLights.resize(numLights);
+	bool lightsChanged = false;
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		Light& light = _lights[i];
+		if (light.power <= 0.0f)
+			continue;
+
+		glm::vec3 color = glm::vec3(light.color.x, light.color.y, light.color.z);
+
+		// Without a set radius the light reaches as far as its brightest channel stays above the cutoff
+		float radius = light.radius;
+		if (radius <= 0.0f)
+			radius = std::sqrt(light.power * std::max(color.x, std::max(color.y, color.z)) / LIGHT_CUTOFF);
+
+		glm::vec4 position = glm::mix(light.prevTransformPos, light.transformPos, alpha);
+		GpuLight& gpuLight = packet.lights[numActive];
+		gpuLight.position_radius = glm::vec4(position.x, position.y, position.z, radius);
+		gpuLight.color_power = glm::vec4(color, light.power);
+		gpuLight.shadowLayer = light.castsShadows && numShadowed < MAX_SHADOWED_LIGHTS ? numShadowed++ : -1;
+
+		GpuLight& built = _builtLights[numActive];
+		if (gpuLight.position_radius != built.position_radius || gpuLight.color_power != built.color_power || gpuLight.shadowLayer != built.shadowLayer)
+		{
+			built = gpuLight;
+			lightsChanged = true;
+		}
+		++numActive;
+	}
+	packet.lights.resize(numActive);
+	_builtLights.resize(numActive);
+	bool sameLights = numActive == numBuilt && _cutError == _builtCutError;
+	if (!sameLights)
+		lightsChanged = true;
+
+	// The light tree only depends on the lights, so it is redone with them and its virtual lights are uploaded with them. While
+	// the same lights only move it is refit in place, and only rebuilt once that has loosened it too far
+	if (lightsChanged)
+	{
+		++_lightVersion;
+		_builtCutError = _cutError;
+		packet.virtualLights.clear();
+		if (!_clustered || _cutError <= 0.0f || numActive <= 1)
+		{
+			_tree.clear();
+		}
+		else if (!sameLights || _tree.empty() || RefitLightTree(packet) > TREE_REFIT_LIMIT * _builtTreeExtent)
+		{
+			_tree.clear();
+			packet.virtualLights.clear();
+			_treeOrder.resize(numActive);
+			for (unsigned int i = 0; i < numActive; ++i)
+				_treeOrder[i] = i;
+			BuildLightTree(packet, 0, numActive);
+
+			_builtTreeExtent = 0.0f;
+			for (unsigned int i = 0; i < _tree.size(); ++i)
+				_builtTreeExtent += _tree[i].extent;
+		}
+	}
+	packet.lightVersion = _lightVersion;
+
+	// Near and far planes recovered from the perspective projection
+	float p22 = packet.projMat[2][2];
+	float p32 = packet.projMat[3][2];
+	float nearPlane = p32 / (p22 - 1.0f);
+	float farPlane = p32 / (p22 + 1.0f);
+
+	// Slices are spaced exponentially so clusters stay roughly cubic with distance, slice = log(depth) * scale + bias
+	float depthScale = CLUSTERS_Z / std::log(farPlane / nearPlane);
+	float depthBias = -std::log(nearPlane) * depthScale;
+
+	GpuLightingParams& params = packet.lightingParams;
+	params.ambient = _ambient;
+	params.clusterTileScale = glm::vec2(CLUSTERS_X / _viewport.x, CLUSTERS_Y / _viewport.y);
+	params.clusterDepth = glm::vec2(depthScale, depthBias);
+
+	// Clusters depend on the camera as much as on the lights, while nothing moves last frame's are still valid
+	bool clustersChanged = lightsChanged || packet.viewMat != _builtViewMat || packet.projMat != _builtProjMat ||
+		params.ambient != _builtParams.ambient || params.clusterTileScale != _builtParams.clusterTileScale;
+	if (clustersChanged)
+	{
+		++_clusterVersion;
+		_builtViewMat = packet.viewMat;
+		_builtProjMat = packet.projMat;
+		_builtParams = params;
+
+		if (_clustered && !_tree.empty())
+		{
+			BuildLightCuts(packet);
+		}
+		else if (_clustered)
+		{
+			BuildClusters(packet, nearPlane, farPlane);
+		}
+		else
+		{
+			packet.clusters.clear();
+			packet.clusterLightIndices.clear();
+		}
+	}
+	packet.clusterVersion = _clusterVersion;
+
+	// Shapes move without the lights changing, so their lists are rebuilt every frame
+	packet.objectLightIndices.clear();
+	if (_clustered)
+		CullObjects(packet);
+}
+
+// Same fade as AddLight in lighting.glsl, x is the distance over the light's radius
+static float FalloffWindow(float x)
+{
+	float window = std::min(std::max(1.0f - x * x * x * x, 0.0f), 1.0f);
+	return window * window;
+}
+
+LightingManager::CutChoice LightingManager::ChooseCut(const LightNode& node, float nearest, float farthest)
+{
+	if (nearest >= node.reach)
+		return CUT_DROP;
+	if (node.left < 0)
+		return CUT_TAKE;
+	if (node.shadowed || node.extent >= _cutError * nearest)
+		return CUT_OPEN;
+
+	// Every light is between nearest - extent and farthest + extent from every point, and the merged radius lies between the
+	// smallest and largest of theirs, so all of their windows and the merged one fall between the window at these two ends
+	float low = std::max(nearest - node.extent, 0.0f) / node.maxRadius;
+	float high = (farthest + node.extent) / node.minRadius;
+	return FalloffWindow(low) - FalloffWindow(high) <= _cutError ? CUT_TAKE : CUT_OPEN;
+}
+
+template <typename Distances, typename Indices>
+void LightingManager::CutTree(const Distances& distances, Indices& indices)
+{
+	// Splitting at the median keeps the tree balanced, so the nodes waiting to be visited never come near this many
+	int stack[64];
+	int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		int index = stack[--depth];
+		const LightNode& node = _tree[index];
+		glm::vec2 range = distances(index);
+		switch (ChooseCut(node, range.x, range.y))
+		{
+		case CUT_TAKE:
+			indices.push_back(index);
+			break;
+		case CUT_OPEN:
+			stack[depth++] = node.left;
+			stack[depth++] = node.right;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void LightingManager::CullObjects(FramePacket& packet)
+{
+	PROFILE_ZONE("LightingManager::CullObjects");
+
+	unsigned int numDraws = packet.drawData.size();
+	unsigned int numLights = packet.lights.size();
+	for (unsigned int i = 0; i < numDraws; ++i)
+	{
+		const glm::vec4& bounds = packet.drawBounds[i];
+		if (bounds.w < 0.0f)
+			continue;
+
+		glm::vec3 center = glm::vec3(bounds.x, bounds.y, bounds.z);
+		unsigned int first = packet.objectLightIndices.size();
+
+		// With cuts on the shape takes the same kind of cut as the clusters, so the list its fragments pick doesn't matter
+		if (!_tree.empty())
+		{
+			float radius = bounds.w;
+			CutTree([center, radius](int node)
+			{
+				float distance = glm::length(_tree[node].center - center);
+				return glm::vec2(std::max(distance - radius, 0.0f), distance + radius);
+			}, packet.objectLightIndices);
+			for (unsigned int j = first; j < packet.objectLightIndices.size(); ++j)
+				packet.objectLightIndices[j] = _tree[packet.objectLightIndices[j]].light;
+			packet.drawData[i].lightRange = glm::uvec2(first, packet.objectLightIndices.size() - first);
+			continue;
+		}
+
+		for (unsigned int j = 0; j < numLights; ++j)
+		{
+			const glm::vec4& light = packet.lights[j].position_radius;
+			float reach = light.w + bounds.w;
+			glm::vec3 offset = glm::vec3(light.x, light.y, light.z) - center;
+			if (glm::dot(offset, offset) < reach * reach)
+				packet.objectLightIndices.push_back(j);
+		}
+		packet.drawData[i].lightRange = glm::uvec2(first, packet.objectLightIndices.size() - first);
+	}
+}
+
+void LightingManager::BuildClusters(FramePacket& packet, float nearPlane, float farPlane)
+{
+	PROFILE_ZONE("LightingManager::BuildClusters");
+
+	float depthScale = packet.lightingParams.clusterDepth.x;
+	float depthBias = packet.lightingParams.clusterDepth.y;
+
+	// Tile boundaries are planes through the eye, stored as unit normals in the x-z and y-z planes pointing towards higher tiles
+	glm::vec2 planesX[CLUSTERS_X + 1];
+	glm::vec2 planesY[CLUSTERS_Y + 1];
+	for (unsigned int i = 0; i <= CLUSTERS_X; ++i)
+	{
+		planesX[i] = glm::normalize(glm::vec2(packet.projMat[0][0], -1.0f + 2.0f * i / CLUSTERS_X));
+	}
+	for (unsigned int i = 0; i <= CLUSTERS_Y; ++i)
+	{
+		planesY[i] = glm::normalize(glm::vec2(packet.projMat[1][1], -1.0f + 2.0f * i / CLUSTERS_Y));
+	}
+
+	// Find the block of clusters each light's sphere overlaps and count the lights per cluster
+	packet.clusters.assign(NUM_CLUSTERS, glm::uvec2(0, 0));
+	unsigned int numLights = packet.lights.size();
+	_bounds.resize(numLights);
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		ClusterBounds& bounds = _bounds[i];
+		bounds.minX = 1;
+		bounds.maxX = 0;
+
+		const GpuLight& light = packet.lights[i];
+		float radius = light.position_radius.w;
+		if (light.color_power.w <= 0.0f)
+			continue;
+
+		glm::vec4 center = packet.viewMat * glm::vec4(light.position_radius.x, light.position_radius.y, light.position_radius.z, 1.0f);
+		float depth = -center.z;
+		if (depth + radius < nearPlane || depth - radius > farPlane)
+			continue;
+
+		// Distance from each boundary plane, positive on the side of the higher tiles
+		float distX[CLUSTERS_X + 1];
+		float distY[CLUSTERS_Y + 1];
+		for (unsigned int j = 0; j <= CLUSTERS_X; ++j)
+		{
+			distX[j] = planesX[j].x * center.x + planesX[j].y * center.z;
+		}
+		for (unsigned int j = 0; j <= CLUSTERS_Y; ++j)
+		{
+			distY[j] = planesY[j].x * center.y + planesY[j].y * center.z;
+		}
+		if (distX[0] < -radius || distX[CLUSTERS_X] > radius || distY[0] < -radius || distY[CLUSTERS_Y] > radius)
+			continue;
+
+		unsigned int minX = 0, maxX = CLUSTERS_X - 1;
+		while (minX < maxX && distX[minX + 1] > radius)
+			++minX;
+		while (maxX > minX && distX[maxX] < -radius)
+			--maxX;
+
+		unsigned int minY = 0, maxY = CLUSTERS_Y - 1;
+		while (minY < maxY && distY[minY + 1] > radius)
+			++minY;
+		while (maxY > minY && distY[maxY] < -radius)
+			--maxY;
+
+		float nearDepth = std::max(depth - radius, nearPlane);
+		float farDepth = std::min(depth + radius, farPlane);
+		int minZ = (int)(std::log(nearDepth) * depthScale + depthBias);
+		int maxZ = (int)(std::log(farDepth) * depthScale + depthBias);
+
+		bounds.minX = (unsigned char)minX;
+		bounds.maxX = (unsigned char)maxX;
+		bounds.minY = (unsigned char)minY;
+		bounds.maxY = (unsigned char)maxY;
+		bounds.minZ = (unsigned char)std::min(std::max(minZ, 0), (int)CLUSTERS_Z - 1);
+		bounds.maxZ = (unsigned char)std::min(std::max(maxZ, 0), (int)CLUSTERS_Z - 1);
+
+		for (unsigned int z = bounds.minZ; z <= bounds.maxZ; ++z)
+			for (unsigned int y = minY; y <= maxY; ++y)
+				for (unsigned int x = minX; x <= maxX; ++x)
+					++packet.clusters[x + CLUSTERS_X * (y + CLUSTERS_Y * z)].y;
+	}
+
+	// Give every cluster its range of the index list, then fill the ranges in, counting back up as lights are added
+	unsigned int numIndices = 0;
+	for (unsigned int i = 0; i < NUM_CLUSTERS; ++i)
+	{
+		packet.clusters[i].x = numIndices;
+		numIndices += packet.clusters[i].y;
+		packet.clusters[i].y = 0;
+	}
+	packet.clusterLightIndices.resize(numIndices);
+
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		const ClusterBounds& bounds = _bounds[i];
+		if (bounds.minX > bounds.maxX)
+			continue;
+
+		for (unsigned int z = bounds.minZ; z <= bounds.maxZ; ++z)
+		{
+			for (unsigned int y = bounds.minY; y <= bounds.maxY; ++y)
+			{
+				for (unsigned int x = bounds.minX; x <= bounds.maxX; ++x)
+				{
+					glm::uvec2& cluster = packet.clusters[x + CLUSTERS_X * (y + CLUSTERS_Y * z)];
+					packet.clusterLightIndices[cluster.x + cluster.y++] = i;
+				}
+			}
+		}
+	}
+}
+
+int LightingManager::BuildLightTree(FramePacket& packet, unsigned int first, unsigned int count)
+{
+	int index = _tree.size();
+	_tree.push_back(LightNode());
+
+	if (count == 1)
+	{
+		LightNode& leaf = _tree[index];
+		leaf.left = leaf.right = -1;
+		leaf.light = _treeOrder[first];
+		FitLeaf(leaf, packet.lights[leaf.light]);
+		return index;
+	}
+
+	// Split at the median along the longest side of the box around the lights, so the tree stays balanced and nodes stay compact
+	glm::vec3 boxMin = glm::vec3(packet.lights[_treeOrder[first]].position_radius);
+	glm::vec3 boxMax = boxMin;
+	for (unsigned int i = first + 1; i < first + count; ++i)
+	{
+		glm::vec3 position = glm::vec3(packet.lights[_treeOrder[i]].position_radius);
+		boxMin = glm::min(boxMin, position);
+		boxMax = glm::max(boxMax, position);
+	}
+	glm::vec3 size = boxMax - boxMin;
+	int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+
+	unsigned int half = count / 2;
+	const GpuLight* lights = &packet.lights[0];
+	std::nth_element(_treeOrder.begin() + first, _treeOrder.begin() + first + half, _treeOrder.begin() + first + count,
+		[lights, axis](unsigned int a, unsigned int b) { return lights[a].position_radius[axis] < lights[b].position_radius[axis]; });
+
+	int left = BuildLightTree(packet, first, half);
+	int right = BuildLightTree(packet, first + half, count - half);
+
+	// Building the children may have moved the tree
+	LightNode& node = _tree[index];
+	node.left = left;
+	node.right = right;
+	node.light = packet.lights.size() + packet.virtualLights.size();
+	packet.virtualLights.push_back(GpuLight());
+	FitNode(node, packet);
+	return index;
+}
+
+float LightingManager::RefitLightTree(FramePacket& packet)
+{
+	PROFILE_ZONE("LightingManager::RefitLightTree");
+
+	// Children always come after their parent, so walking backwards fits both children before the node joining them
+	packet.virtualLights.resize(_tree.size() - packet.lights.size());
+	float extent = 0.0f;
+	for (unsigned int i = _tree.size(); i-- > 0;)
 	{
-		_lights[i].position += _lights[i].linearVelocity * dt;
-		_lights[i].rotation = glm::slerp(_lights[i].rotation, _lights[i].rotation * _lights[i].angularVelocity, dt);
+		LightNode& node = _tree[i];
+		if (node.left < 0)
+			FitLeaf(node, packet.lights[node.light]);
+		else
+			FitNode(node, packet);
+		extent += node.extent;
+	}
+	return extent;
+}
+
+void LightingManager::FitLeaf(LightNode& leaf, const GpuLight& light)
+{
+	leaf.center = glm::vec3(light.position_radius.x, light.position_radius.y, light.position_radius.z);
+	leaf.extent = 0.0f;
+	leaf.reach = light.position_radius.w;
+	leaf.minRadius = leaf.maxRadius = light.position_radius.w;
+	leaf.weightedRadius = light.position_radius.w * light.color_power.w;
+	leaf.flux = glm::vec3(light.color_power.x, light.color_power.y, light.color_power.z) * light.color_power.w;
+	leaf.power = light.color_power.w;
+	leaf.shadowed = light.shadowLayer >= 0;
+}
+
+void LightingManager::FitNode(LightNode& node, FramePacket& packet)
+{
+	const LightNode& a = _tree[node.left];
+	const LightNode& b = _tree[node.right];
+	node.power = a.power + b.power;
+	node.flux = a.flux + b.flux;
+	node.center = (a.center * a.power + b.center * b.power) / node.power;
+	float distA = glm::length(a.center - node.center);
+	float distB = glm::length(b.center - node.center);
+	node.extent = std::max(distA + a.extent, distB + b.extent);
+	node.reach = std::max(distA + a.reach, distB + b.reach);
+	node.minRadius = std::min(a.minRadius, b.minRadius);
+	node.maxRadius = std::max(a.maxRadius, b.maxRadius);
+	node.weightedRadius = a.weightedRadius + b.weightedRadius;
+	node.shadowed = a.shadowed || b.shadowed;
 
-		glm::mat4 translateMat = glm::translate(glm::mat4(), _lights[i].position);
+	GpuLight& light = packet.virtualLights[node.light - packet.lights.size()];
+	light.position_radius = glm::vec4(node.center, node.weightedRadius / node.power);
+	light.color_power = glm::vec4(node.flux / node.power, node.power);
+	light.shadowLayer = -1;
+	light.padding[0] = light.padding[1] = light.padding[2] = 0;
+}
 
-		glm::mat4 rotateOriginMat = glm::translate(glm::mat4(), _lights[i].rotationOrigin);
-		glm::mat4 rotateMat = rotateOriginMat * glm::mat4_cast(_lights[i].rotation) * glm::inverse(rotateOriginMat);
+void LightingManager::BuildLightCuts(FramePacket& packet)
+{
+	PROFILE_ZONE("LightingManager::BuildLightCuts");
 
-		_lights[i].transformPos = translateMat * rotateMat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	float depthScale = packet.lightingParams.clusterDepth.x;
+	float depthBias = packet.lightingParams.clusterDepth.y;
 
-		glm::vec4 color_power = glm::vec4(_lights[i].color.swizzle(glm::comp::X, glm::comp::Y, glm::comp::Z), _lights[i].power);
+	// Boundaries of the depth slices and of the tiles at a view depth of 1, tiles widen in proportion to depth
+	float depths[CLUSTERS_Z + 1];
+	float tilesX[CLUSTERS_X + 1];
+	float tilesY[CLUSTERS_Y + 1];
+	for (unsigned int i = 0; i <= CLUSTERS_Z; ++i)
+	{
+		depths[i] = std::exp((i - depthBias) / depthScale);
+	}
+	for (unsigned int i = 0; i <= CLUSTERS_X; ++i)
+	{
+		tilesX[i] = (-1.0f + 2.0f * i / CLUSTERS_X) / packet.projMat[0][0];
+	}
+	for (unsigned int i = 0; i <= CLUSTERS_Y; ++i)
+	{
+		tilesY[i] = (-1.0f + 2.0f * i / CLUSTERS_Y) / packet.projMat[1][1];
+	}
 
-		glUniform4fv(_lights[i].uPosition, 1, glm::value_ptr(_lights[i].transformPos));
-		glUniform4fv(_lights[i].uColor_difPower, 1, glm::value_ptr(color_power));
+	unsigned int numNodes = _tree.size();
+	_viewCenters.resize(numNodes);
+	for (unsigned int i = 0; i < numNodes; ++i)
+	{
+		_viewCenters[i] = glm::vec3(packet.viewMat * glm::vec4(_tree[i].center, 1.0f));
+	}
 
-		if (_lightShapes[i])
+	// Each block of clusters in a depth slice walks down from the root once, see ChooseCut. Whatever the block takes, each of its
+	// clusters could take too, as a cluster is no closer to any node and spans less, so clusters only drop the nodes they are
+	// out of reach of. Depth slices are cut on the worker threads, each into its own list with offsets counted from the start of it
+	packet.clusters.resize(NUM_CLUSTERS);
+	WorkerPool::ParallelFor(CLUSTERS_Z, 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int z = begin; z < end; ++z)
 		{
-			_lightShapes[i]->active() = _lights[i].power > 0.0f;
-			_lightShapes[i]->transform().position = glm::vec3(_lights[i].transformPos);
-			_lightShapes[i]->transform().scale = glm::vec3(0.1f, 0.1f, 0.1f);
-			_lightShapes[i]->currentColor() = _lights[i].color;
+			TrackedVector<GLuint, MEM_LIGHTING>& indices = _sliceIndices[z];
+			TrackedVector<GLuint, MEM_LIGHTING>& blockCut = _sliceBlockCuts[z];
+			indices.clear();
+			float nearDepth = depths[z];
+			float farDepth = depths[z + 1];
+
+			// View space box around the tiles from minX up to maxX and minY up to maxY in this slice
+			auto box = [&](unsigned int minX, unsigned int maxX, unsigned int minY, unsigned int maxY, glm::vec3& boxMin, glm::vec3& boxMax)
+			{
+				boxMin = glm::vec3(std::min(tilesX[minX] * nearDepth, tilesX[minX] * farDepth),
+					std::min(tilesY[minY] * nearDepth, tilesY[minY] * farDepth), -farDepth);
+				boxMax = glm::vec3(std::max(tilesX[maxX] * nearDepth, tilesX[maxX] * farDepth),
+					std::max(tilesY[maxY] * nearDepth, tilesY[maxY] * farDepth), -nearDepth);
+			};
+
+			for (unsigned int blockY = 0; blockY < CLUSTERS_Y; blockY += CUT_BLOCK_Y)
+			{
+				for (unsigned int blockX = 0; blockX < CLUSTERS_X; blockX += CUT_BLOCK_X)
+				{
+					glm::vec3 boxMin, boxMax;
+					box(blockX, blockX + CUT_BLOCK_X, blockY, blockY + CUT_BLOCK_Y, boxMin, boxMax);
+					blockCut.clear();
+					CutTree([boxMin, boxMax](int node)
+					{
+						const glm::vec3& center = _viewCenters[node];
+						glm::vec3 farCorner = glm::max(glm::abs(center - boxMin), glm::abs(center - boxMax));
+						return glm::vec2(glm::length(center - glm::clamp(center, boxMin, boxMax)), glm::length(farCorner));
+					}, blockCut);
+
+					unsigned int cutSize = blockCut.size();
+					for (unsigned int y = blockY; y < blockY + CUT_BLOCK_Y; ++y)
+					{
+						for (unsigned int x = blockX; x < blockX + CUT_BLOCK_X; ++x)
+						{
+							box(x, x + 1, y, y + 1, boxMin, boxMax);
+							unsigned int first = indices.size();
+							for (unsigned int i = 0; i < cutSize; ++i)
+							{
+								const LightNode& node = _tree[blockCut[i]];
+								const glm::vec3& center = _viewCenters[blockCut[i]];
+								glm::vec3 offset = center - glm::clamp(center, boxMin, boxMax);
+								if (glm::dot(offset, offset) < node.reach * node.reach)
+									indices.push_back(node.light);
+							}
+							packet.clusters[x + CLUSTERS_X * (y + CLUSTERS_Y * z)] = glm::uvec2(first, indices.size() - first);
+						}
+					}
+				}
+			}
 		}
+	});
+
+	// Join the slices' lists, moving each slice's offsets along by the indices before it
+	packet.clusterLightIndices.clear();
+	for (unsigned int z = 0; z < CLUSTERS_Z; ++z)
+	{
+		GLuint base = packet.clusterLightIndices.size();
+		for (unsigned int i = CLUSTERS_X * CLUSTERS_Y * z; i < CLUSTERS_X * CLUSTERS_Y * (z + 1); ++i)
+			packet.clusters[i].x += base;
+		packet.clusterLightIndices.insert(packet.clusterLightIndices.end(), _sliceIndices[z].begin(), _sliceIndices[z].end());
+	}
+}
+
+// Orphans the buffer's storage and refills it, a buffer is never left empty so it can always be bound
+template <typename V>
+static void UploadStorage(GLuint buffer, GLuint binding, const V& values, const char* owner)
+{
+	size_t bytes = sizeof(typename V::value_type) * std::max((size_t)values.size(), (size_t)1);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, values.empty() ? NULL : &values[0], GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+	MemoryTracker::TrackGL(GL_BUFFER, buffer, bytes, owner);
+	RenderManager::RecordUpload(bytes);
+}
+
+void LightingManager::Apply(const FramePacket& packet)
+{
+	PROFILE_ZONE("LightingManager::Apply");
+
+	// Packets arrive in the order they were built, so a version already uploaded means the buffers hold this packet's values
+	GpuProfiler::BeginPass("lights");
+	if (packet.lightVersion != _uploadedLightVersion)
+	{
+		// Virtual lights follow the real ones in the same buffer, clusters index either
+		size_t realBytes = sizeof(GpuLight) * packet.lights.size();
+		size_t virtualBytes = sizeof(GpuLight) * packet.virtualLights.size();
+		size_t bytes = std::max(realBytes + virtualBytes, sizeof(GpuLight));
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, _lightBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+		if (realBytes)
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, realBytes, &packet.lights[0]);
+		if (virtualBytes)
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, realBytes, virtualBytes, &packet.virtualLights[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, _lightBuffer);
+		MemoryTracker::TrackGL(GL_BUFFER, _lightBuffer, bytes, "lights");
+		RenderManager::RecordUpload(bytes);
+
+		_uploadedLightVersion = packet.lightVersion;
+		_uploadedLights = packet.lights.size();
+	}
+
+	if (packet.clusterVersion != _uploadedClusterVersion)
+	{
+		UploadStorage(_clusterBuffer, CLUSTER_BINDING, packet.clusters, "light clusters");
+		UploadStorage(_lightIndexBuffer, LIGHT_INDEX_BINDING, packet.clusterLightIndices, "light cluster indices");
+
+		glBindBuffer(GL_UNIFORM_BUFFER, _paramsBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(GpuLightingParams), &packet.lightingParams, GL_STREAM_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_PARAMS_BINDING, _paramsBuffer);
+		MemoryTracker::TrackGL(GL_BUFFER, _paramsBuffer, sizeof(GpuLightingParams), "lighting params");
+		RenderManager::RecordUpload(sizeof(GpuLightingParams));
+
+		_uploadedClusterVersion = packet.clusterVersion;
+	}
+
+	UploadStorage(_objectLightBuffer, OBJECT_LIGHT_BINDING, packet.objectLightIndices, "object light indices");
+	GpuProfiler::EndPass();
+}
+
+const Shader* LightingManager::ForwardShader()
+{
+	if (_uploadedLights > MAX_SPECIALIZED_LIGHTS)
+		return nullptr;
+
+	Shader& variant = _variants[_uploadedLights];
+	CompileVariant(variant, "#define NUM_LIGHTS " + std::to_string(_uploadedLights) + "\n");
+	return &variant;
+}
+
+const Shader* LightingManager::VertexLitShader()
+{
+	if (_uploadedLights > MAX_SPECIALIZED_LIGHTS)
+	{
+		CompileVariant(_vertexLitVariants[MAX_SPECIALIZED_LIGHTS + 1], "#define PER_VERTEX_LIGHTING\n");
+		return &_vertexLitVariants[MAX_SPECIALIZED_LIGHTS + 1];
 	}
+
+	Shader& variant = _vertexLitVariants[_uploadedLights];
+	CompileVariant(variant, "#define PER_VERTEX_LIGHTING\n#define NUM_LIGHTS " + std::to_string(_uploadedLights) + "\n");
+	return &variant;
+}
+
+void LightingManager::CompileVariant(Shader& variant, const std::string& defines)
+{
+	if (variant.shaderPointer)
+		return;
+
+	PROFILE_ZONE("LightingManager::CompileVariant");
+
+	char* shaders[] = { "fShader.glsl", "vShader.glsl" };
+	GLenum types[] = { GL_FRAGMENT_SHADER, GL_VERTEX_SHADER };
+	variant.shaderPointer = initShaders(shaders, types, 2, defines.c_str());
+	variant.uCamPos = glGetUniformLocation(variant.shaderPointer, "camPos");
+	variant.uDrawOffset = glGetUniformLocation(variant.shaderPointer, "drawOffset");
+}
+
+LightHandle LightingManager::AddLight()
+{
+	if (_lights.Size() >= MAX_LIGHTS)
+		return LightHandle();
+
+	LightHandle handle = _lights.Create();
+	Light* light = _lights.Get(handle);
+	light->position = glm::vec3();
+	light->linearVelocity = glm::vec3();
+	light->rotation = glm::quat();
+	light->rotationOrigin = glm::vec3();
+	light->angularVelocity = glm::quat();
+	light->transformPos = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	light->prevTransformPos = light->transformPos;
+	light->color = glm::vec4();
+	light->power = 0.0f;
+	light->radius = 0.0f;
+	light->castsShadows = false;
+	return handle;
 }
-Light& LightingManager::GetLight(int index)
+
+void LightingManager::RemoveLight(LightHandle light)
+{
+	Light* toRemove = _lights.Get(light);
+	if (toRemove)
+		RenderManager::DestroyShape(toRemove->shape);
+	_lights.Destroy(light);
+}
+
+Light* LightingManager::GetLight(LightHandle light)
 {
-	return _lights[index];
+	return _lights.Get(light);
 }
 
-void LightingManager::SetLightShape(RenderShape* shape, int index)
+void LightingManager::SetLightShape(ShapeHandle shape, LightHandle light)
 {
-	_lightShapes[index] = shape;
-	RenderManager::AddShape(shape);
+	_lights.Get(light)->shape = shape;
 }
 
 void LightingManager::SetAmbient(glm::vec3 color)
 {
 	_ambient = glm::vec4(color, 1.0f);
-	glUniform4fv(_uAmbient, 1, glm::value_ptr(_ambient));
 }
 
-	
\ No newline at end of file
+void LightingManager::DumpData()
+{
+	_lights.Release();
+	ReleaseVector(_bounds);
+	ReleaseVector(_builtLights);
+	ReleaseVector(_tree);
+	ReleaseVector(_treeOrder);
+	ReleaseVector(_viewCenters);
+	for (unsigned int i = 0; i < CLUSTERS_Z; ++i)
+	{
+		ReleaseVector(_sliceIndices[i]);
+		ReleaseVector(_sliceBlockCuts[i]);
+	}
+
+	MemoryTracker::UntrackGL(GL_BUFFER, _lightBuffer);
+	MemoryTracker::UntrackGL(GL_BUFFER, _clusterBuffer);
+	MemoryTracker::UntrackGL(GL_BUFFER, _lightIndexBuffer);
+	MemoryTracker::UntrackGL(GL_BUFFER, _objectLightBuffer);
+	MemoryTracker::UntrackGL(GL_BUFFER, _paramsBuffer);
+	glDeleteBuffers(1, &_lightBuffer);
+	glDeleteBuffers(1, &_clusterBuffer);
+	glDeleteBuffers(1, &_lightIndexBuffer);
+	glDeleteBuffers(1, &_objectLightBuffer);
+	glDeleteBuffers(1, &_paramsBuffer);
+	_lightBuffer = _clusterBuffer = _lightIndexBuffer = _objectLightBuffer = _paramsBuffer = 0;
+
+	for (unsigned int i = 0; i <= MAX_SPECIALIZED_LIGHTS; ++i)
+	{
+		glDeleteProgram(_variants[i].shaderPointer);
+		_variants[i].shaderPointer = 0;
+	}
+	for (unsigned int i = 0; i <= MAX_SPECIALIZED_LIGHTS + 1; ++i)
+	{
+		glDeleteProgram(_vertexLitVariants[i].shaderPointer);
+		_vertexLitVariants[i].shaderPointer = 0;
+	}
+}
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <GLM\gtc\matrix_transform.hpp>
 #include <GLM\gtc\quaternion.hpp>
 #include "RenderShape.h"
+#include "Pool.h"
+#include <string>
 struct Light
 {
 	glm::vec3 position;
@@ -11,30 +13,210 @@ struct Light
 	glm::vec3 rotationOrigin;
 	glm::quat angularVelocity;
 	glm::vec4 color;
-	GLint uColor_difPower;
 	glm::vec4 transformPos;
-	GLint uPosition;
+	// transformPos before the last step, rendering blends from it
+	glm::vec4 prevTransformPos;
 	float power;
+	// Distance at which the light has faded out entirely, 0 derives it from power
+	float radius;
+	// The first MAX_SHADOWED_LIGHTS lights that are on and have this set get a shadow cube
+	bool castsShadows;
+	ShapeHandle shape;
 };
+typedef Handle<Light> LightHandle;
 
+// A light as the shaders read it, matches Light in lighting.glsl (std430)
+struct GpuLight
+{
+	glm::vec4 position_radius;
+	glm::vec4 color_power;
+	// Layer of the light's cube in the shadow map array, -1 for lights without shadows
+	GLint shadowLayer;
+	GLint padding[3];
+};
+
+// Values every lighting shader reads from the LightingParams uniform block in lighting.glsl (std140)
+struct GpuLightingParams
+{
+	glm::vec4 ambient;
+	// Clusters per pixel on screen, and the scale and bias turning log(view depth) into a depth slice
+	glm::vec2 clusterTileScale;
+	glm::vec2 clusterDepth;
+};
+
+struct FramePacket;
+
+// Lights are shaded with clustered forward lighting. The view frustum is split into a grid of clusters, tiles on screen by
+// exponentially spaced depth slices, and every frame each light is binned into the clusters its radius reaches.
+// Every shape with bounds also gets a list of the lights reaching it, and fragments loop over whichever list is shorter.
+// For very many lights the light cut error can be raised above 0, which builds a tree over the lights and lets each cluster
+// and shape take a group of lights that is small and far away as one virtual light standing in for all of them. Both lists are
+// cut with the same bound, so whichever a fragment picks, and whichever cluster it falls in, its lighting stays within it.
+// While the same lights only move the tree is refit rather than rebuilt, and each block of tiles in a depth slice shares one cut.
+// Lights, clusters and lighting parameters live in buffers at fixed binding points that any program including lighting.glsl reads,
+// and each is only uploaded when it differs from the last frame.
 class LightingManager
 {
 public:
-	static void Init(Shader lightingShader);
+	static void Init();
+	// Size in pixels of the framebuffer being lit, fragments find their cluster tile from it
+	static void SetViewport(int width, int height);
+	// Deferred shading draws every light as a volume and has no use for clusters, turning them off skips binning
+	static void SetClustered(bool clustered);
+	// Quality knob for many lights. A group of lights is shaded as one virtual light by a cluster or shape only where the group's
+	// size is under ratio times its distance, which keeps each light's inverse square term within (1 +- ratio)^-2 of the merged
+	// one, and where every light's falloff window differs from the merged light's by at most ratio over the distances the cluster
+	// or shape spans. 0 bins every light exactly and is the default
+	static void SetLightCutError(float ratio);
 	static void Update(float dt);
-	static Light& GetLight(int index);
-	static void SetLightShape(RenderShape* shape, int index);
+	// Simulation thread, copies every light into the packet, with positions alpha of the way between the last two steps,
+	// bins them into clusters using the packet's view and projection matrices and lists the lights reaching each draw, so
+	// RenderManager::BuildFrame must run first. Clusters are only rebuilt when the lights or the camera changed since the last frame built
+	static void BuildFrame(FramePacket& packet, float alpha);
+	// Render thread, uploads the packet's lights, clusters and parameters if their versions differ from what was last uploaded
+	static void Apply(const FramePacket& packet);
+	// Render thread, the program to light the forward pass with for the last packet applied. With few enough lights on it is a
+	// variant of the phong shader compiled for exactly that many, compiled the first time it is needed and kept from then on.
+	// Otherwise it is nullptr and shapes keep their own clustered shader
+	static const Shader* ForwardShader();
+	// Render thread, the program to light shapes with per vertex in the forward pass for the last packet applied, also specialized
+	// to the light count when it is small enough. Compiled the first time it is needed like the forward variants, RenderManager::DrawPass
+	// only asks for it once a batch lit per vertex comes up
+	static const Shader* VertexLitShader();
+	// Returns an invalid handle once MAX_LIGHTS lights exist
+	static LightHandle AddLight();
+	static void RemoveLight(LightHandle light);
+	static Light* GetLight(LightHandle light);
+	static void SetLightShape(ShapeHandle shape, LightHandle light);
 	static void SetAmbient(glm::vec3 color);
+	static void DumpData();
+
+	static const int MAX_LIGHTS = 4096;
+	static const unsigned int MAX_SHADOWED_LIGHTS = 8;
+	// Light counts up to this one get a phong shader variant of their own
+	static const unsigned int MAX_SPECIALIZED_LIGHTS = 8;
+
+	static const unsigned int CLUSTERS_X = 16;
+	static const unsigned int CLUSTERS_Y = 9;
+	static const unsigned int CLUSTERS_Z = 24;
+	static const unsigned int NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+	// Tiles of a depth slice that share one cut through the light tree, must divide CLUSTERS_X and CLUSTERS_Y
+	static const unsigned int CUT_BLOCK_X = 4;
+	static const unsigned int CUT_BLOCK_Y = 3;
+
+	// Shader storage binding points, must match the bindings in lighting.glsl
+	static const GLuint LIGHT_BINDING = 1;
+	static const GLuint CLUSTER_BINDING = 2;
+	static const GLuint LIGHT_INDEX_BINDING = 3;
+	static const GLuint OBJECT_LIGHT_BINDING = 7;
+	// Uniform buffer binding point of the lighting parameters
+	static const GLuint LIGHTING_PARAMS_BINDING = 0;
 private:
-	static const int MAX_LIGHTS = 8;
+	// Range of clusters a light reaches, inclusive
+	struct ClusterBounds
+	{
+		unsigned char minX, maxX;
+		unsigned char minY, maxY;
+		unsigned char minZ, maxZ;
+	};
+
+	// A node of the light tree, one light or the union of two nodes. Every node above the leaves is also a virtual light that is
+	// uploaded after the real ones, at its lights' power weighted center with their summed power and power weighted radius
+	struct LightNode
+	{
+		glm::vec3 center;
+		// Distance from the center to the farthest light in the node
+		float extent;
+		// Distance from the center beyond which no light in the node has any effect, only used to drop the node
+		float reach;
+		// Smallest and largest radius of the lights in the node
+		float minRadius, maxRadius;
+		glm::vec3 flux;
+		float power;
+		// Sum of each light's radius times its power
+		float weightedRadius;
+		// Children, -1 for leaves
+		int left, right;
+		// Index of the real or virtual light in the light buffer
+		GLuint light;
+		// Nodes holding a shadowed light are never merged, virtual lights have no shadows
+		bool shadowed;
+	};
+
+	static void BuildClusters(FramePacket& packet, float nearPlane, float farPlane);
+	// Builds the subtree over count lights of _treeOrder from first, returns the index of its root
+	static int BuildLightTree(FramePacket& packet, unsigned int first, unsigned int count);
+	// Refits every node of the tree to where the packet's lights are now, keeping its shape. Returns the summed extent of the nodes
+	static float RefitLightTree(FramePacket& packet);
+	static void FitLeaf(LightNode& leaf, const GpuLight& light);
+	// Fits a node around its two children and writes its virtual light into the packet
+	static void FitNode(LightNode& node, FramePacket& packet);
+	// Fills the clusters with the cut through the light tree each one needs, in place of BuildClusters when the cut error is above 0.
+	// Each CUT_BLOCK_X by CUT_BLOCK_Y block of tiles in a depth slice is cut once, and its clusters drop what is out of their reach
+	static void BuildLightCuts(FramePacket& packet);
+	// Whether a cluster or shape whose points lie between nearest and farthest from the node's center drops the node,
+	// takes it whole or has to look at its children
+	enum CutChoice
+	{
+		CUT_DROP,
+		CUT_TAKE,
+		CUT_OPEN
+	};
+	static CutChoice ChooseCut(const LightNode& node, float nearest, float farthest);
+	// Appends the nodes of the cut through the light tree one cluster or shape needs to indices, distances(node) gives the nearest
+	// and farthest the cluster or shape gets from the node's center
+	template <typename Distances, typename Indices>
+	static void CutTree(const Distances& distances, Indices& indices);
+	// Fills in every bounded draw's range of packet.objectLightIndices with the lights whose radius reaches its bounds, or with
+	// the cut through the light tree its bounds need when the cut error is above 0
+	static void CullObjects(FramePacket& packet);
+	// Compiles the phong shader into variant with the given defines unless that was already done
+	static void CompileVariant(Shader& variant, const std::string& defines);
+
+	// Intensity below which a light is treated as having no effect, used when a light's radius is left at 0
+	static const float LIGHT_CUTOFF;
+	// A refit tree whose nodes have grown past this many times their summed extent when it was built is built again
+	static const float TREE_REFIT_LIMIT;
 
-	static Light _lights[MAX_LIGHTS];
-	static GLfloat _lightBufferData[MAX_LIGHTS * 8];
-	static RenderShape* _lightShapes[MAX_LIGHTS];
+	static Pool<Light, MEM_LIGHTING> _lights;
 
-	static GLint _shader;
-	static GLuint _uLights;
+	static GLuint _lightBuffer;
+	static GLuint _clusterBuffer;
+	static GLuint _lightIndexBuffer;
+	static GLuint _objectLightBuffer;
+	static GLuint _paramsBuffer;
 
 	static glm::vec4 _ambient;
-	static GLuint _uAmbient;
+	static glm::vec2 _viewport;
+	static bool _clustered;
+	static float _cutError;
+
+	// Simulation thread, what the last frame was built from, and versions bumped whenever a frame differs from it
+	static TrackedVector<GpuLight, MEM_LIGHTING> _builtLights;
+	static GpuLightingParams _builtParams;
+	static glm::mat4 _builtViewMat;
+	static glm::mat4 _builtProjMat;
+	static unsigned int _lightVersion;
+	static unsigned int _clusterVersion;
+	static float _builtCutError;
+	static TrackedVector<LightNode, MEM_LIGHTING> _tree;
+	// Summed extent of the tree's nodes when it was last built
+	static float _builtTreeExtent;
+
+	// Render thread, versions of the data currently in the buffers
+	static unsigned int _uploadedLightVersion;
+	static unsigned int _uploadedClusterVersion;
+	static unsigned int _uploadedLights;
+
+	// Phong programs by number of lights, a shaderPointer of 0 until compiled
+	static Shader _variants[MAX_SPECIALIZED_LIGHTS + 1];
+	// The same lighting per vertex, the last one for any number of lights
+	static Shader _vertexLitVariants[MAX_SPECIALIZED_LIGHTS + 2];
+
+	// Scratch space for binning, kept between frames to avoid reallocating
+	static TrackedVector<ClusterBounds, MEM_LIGHTING> _bounds;
+	static TrackedVector<unsigned int, MEM_LIGHTING> _treeOrder;
+	static TrackedVector<glm::vec3, MEM_LIGHTING> _viewCenters;
+	static TrackedVector<GLuint, MEM_LIGHTING> _sliceIndices[CLUSTERS_Z];
+	static TrackedVector<GLuint, MEM_LIGHTING> _sliceBlockCuts[CLUSTERS_Z];
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "MemoryTracker.h"
+#include <iostream>
+
+MemoryTracker::TagCounters MemoryTracker::_tags[NUM_MEMORY_TAGS];
+
+std::mutex MemoryTracker::_glMutex;
+std::map<std::pair<GLenum, GLuint>, MemoryTracker::GLAllocation> MemoryTracker::_glObjects = std::map<std::pair<GLenum, GLuint>, MemoryTracker::GLAllocation>();
+
+const char* MemoryTracker::TAG_NAMES[NUM_MEMORY_TAGS] = { "untagged", "transforms", "render", "frame packets", "geometry", "patches", "lighting", "animation", "profiler" };
+
+static double Megabytes(size_t bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+void MemoryTracker::Allocated(MemoryTag tag, size_t bytes)
+{
+	TagCounters& counters = _tags[tag];
+	size_t total = counters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+
+	size_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+	while (total > peak && !counters.peakBytes.compare_exchange_weak(peak, total, std::memory_order_relaxed));
+}
+
+void MemoryTracker::Freed(MemoryTag tag, size_t bytes)
+{
+	_tags[tag].bytes.fetch_sub(bytes, std::memory_order_relaxed);
+	_tags[tag].allocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryTracker::TrackGL(GLenum type, GLuint name, size_t bytes, const char* owner)
+{
+	std::lock_guard<std::mutex> lock(_glMutex);
+	GLAllocation& allocation = _glObjects[std::make_pair(type, name)];
+	allocation.bytes = bytes;
+	allocation.owner = owner;
+}
+
+void MemoryTracker::UntrackGL(GLenum type, GLuint name)
+{
+	std::lock_guard<std::mutex> lock(_glMutex);
+	_glObjects.erase(std::make_pair(type, name));
+}
+
+size_t MemoryTracker::cpuBytes(MemoryTag tag) { return _tags[tag].bytes.load(std::memory_order_relaxed); }
+size_t MemoryTracker::cpuPeakBytes(MemoryTag tag) { return _tags[tag].peakBytes.load(std::memory_order_relaxed); }
+unsigned int MemoryTracker::cpuAllocations(MemoryTag tag) { return _tags[tag].allocations.load(std::memory_order_relaxed); }
+
+size_t MemoryTracker::gpuBytes(const char* owner)
+{
+	std::lock_guard<std::mutex> lock(_glMutex);
+	size_t total = 0;
+	for (std::map<std::pair<GLenum, GLuint>, GLAllocation>::iterator it = _glObjects.begin(); it != _glObjects.end(); ++it)
+	{
+		if (it->second.owner == owner)
+			total += it->second.bytes;
+	}
+	return total;
+}
+
+size_t MemoryTracker::gpuBytes()
+{
+	std::lock_guard<std::mutex> lock(_glMutex);
+	size_t total = 0;
+	for (std::map<std::pair<GLenum, GLuint>, GLAllocation>::iterator it = _glObjects.begin(); it != _glObjects.end(); ++it)
+	{
+		total += it->second.bytes;
+	}
+	return total;
+}
+
+void MemoryTracker::LogReport()
+{
+	std::cout << "CPU memory (MB, current / peak, live allocations)" << std::endl;
+	for (unsigned int i = 0; i < NUM_MEMORY_TAGS; ++i)
+	{
+		MemoryTag tag = (MemoryTag)i;
+		if (cpuPeakBytes(tag) == 0)
+			continue;
+		std::cout << "  " << TAG_NAMES[i] << " " << Megabytes(cpuBytes(tag)) << " / " << Megabytes(cpuPeakBytes(tag)) << ", " << cpuAllocations(tag) << std::endl;
+	}
+
+	// Sum per owner, there are few enough owners that a linear search is fine
+	std::vector<std::pair<std::string, std::pair<size_t, unsigned int>>> owners;
+	{
+		std::lock_guard<std::mutex> lock(_glMutex);
+		for (std::map<std::pair<GLenum, GLuint>, GLAllocation>::iterator it = _glObjects.begin(); it != _glObjects.end(); ++it)
+		{
+			unsigned int j = 0;
+			while (j < owners.size() && owners[j].first != it->second.owner)
+				++j;
+			if (j == owners.size())
+				owners.push_back(std::make_pair(it->second.owner, std::make_pair((size_t)0, 0u)));
+			owners[j].second.first += it->second.bytes;
+			++owners[j].second.second;
+		}
+	}
+
+	std::cout << "GL memory (MB, objects)" << std::endl;
+	for (unsigned int i = 0; i < owners.size(); ++i)
+	{
+		std::cout << "  " << owners[i].first << " " << Megabytes(owners[i].second.first) << ", " << owners[i].second.second << std::endl;
+	}
+}
+
+bool MemoryTracker::Shutdown()
+{
+	LogReport();
+
+	bool leaked = false;
+	for (unsigned int i = 0; i < NUM_MEMORY_TAGS; ++i)
+	{
+		MemoryTag tag = (MemoryTag)i;
+		if (cpuAllocations(tag) == 0)
+			continue;
+		std::cerr << "Leak: " << cpuAllocations(tag) << " " << TAG_NAMES[i] << " allocations holding " << cpuBytes(tag) << " bytes" << std::endl;
+		leaked = true;
+	}
+
+	std::lock_guard<std::mutex> lock(_glMutex);
+	for (std::map<std::pair<GLenum, GLuint>, GLAllocation>::iterator it = _glObjects.begin(); it != _glObjects.end(); ++it)
+	{
+		std::cerr << "Leak: GL object " << it->first.second << " of " << it->second.owner << " holding " << it->second.bytes << " bytes" << std::endl;
+		leaked = true;
+	}
+	return !leaked;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Subsystem a CPU allocation is charged to
+enum MemoryTag
+{
+	MEM_UNTAGGED,
+	MEM_TRANSFORMS,
+	MEM_RENDER,
+	MEM_FRAME_PACKETS,
+	MEM_GEOMETRY,
+	MEM_PATCHES,
+	MEM_LIGHTING,
+	MEM_ANIMATION,
+	MEM_PROFILER,
+	NUM_MEMORY_TAGS
+};
+
+// Counts the bytes every subsystem holds on the CPU heap and in GL objects.
+// CPU memory is charged through TrackedAllocator containers and New/Delete, GL objects are registered by whoever creates them.
+// Everything still held when Shutdown is called is reported as a leak.
+class MemoryTracker
+{
+public:
+	static void Allocated(MemoryTag tag, size_t bytes);
+	static void Freed(MemoryTag tag, size_t bytes);
+
+	template <typename T, typename... Args>
+	static T* New(MemoryTag tag, Args&&... args)
+	{
+		Allocated(tag, sizeof(T));
+		return new T(std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	static void Delete(MemoryTag tag, T* object)
+	{
+		if (!object)
+			return;
+		Freed(tag, sizeof(T));
+		delete object;
+	}
+
+	// Records the storage of a GL object, calling it again for the same object replaces its size.
+	// type is the object's namespace, GL_BUFFER, GL_TEXTURE or GL_RENDERBUFFER
+	static void TrackGL(GLenum type, GLuint name, size_t bytes, const char* owner);
+	static void UntrackGL(GLenum type, GLuint name);
+
+	static size_t cpuBytes(MemoryTag tag);
+	static size_t cpuPeakBytes(MemoryTag tag);
+	static unsigned int cpuAllocations(MemoryTag tag);
+	static size_t gpuBytes(const char* owner);
+	static size_t gpuBytes();
+
+	static void LogReport();
+	// Logs the report followed by everything still allocated, returns false if anything leaked
+	static bool Shutdown();
+
+	static const char* TAG_NAMES[NUM_MEMORY_TAGS];
+private:
+	struct TagCounters
+	{
+		std::atomic<size_t> bytes;
+		std::atomic<size_t> peakBytes;
+		std::atomic<unsigned int> allocations;
+	};
+
+	struct GLAllocation
+	{
+		size_t bytes;
+		std::string owner;
+	};
+
+	static TagCounters _tags[NUM_MEMORY_TAGS];
+
+	static std::mutex _glMutex;
+	static std::map<std::pair<GLenum, GLuint>, GLAllocation> _glObjects;
+};
+
+// Standard allocator that charges everything it hands out to TAG
+template <typename T, MemoryTag TAG>
+class TrackedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef TrackedAllocator<U, TAG> other; };
+
+	TrackedAllocator() {}
+	template <typename U>
+	TrackedAllocator(const TrackedAllocator<U, TAG>&) {}
+
+	T* allocate(size_t count)
+	{
+		MemoryTracker::Allocated(TAG, sizeof(T) * count);
+		return static_cast<T*>(::operator new(sizeof(T) * count));
+	}
+
+	void deallocate(T* pointer, size_t count)
+	{
+		MemoryTracker::Freed(TAG, sizeof(T) * count);
+		::operator delete(pointer);
+	}
+
+	template <typename U>
+	bool operator==(const TrackedAllocator<U, TAG>&) const { return true; }
+	template <typename U>
+	bool operator!=(const TrackedAllocator<U, TAG>&) const { return false; }
+};
+
+template <typename T, MemoryTag TAG>
+using TrackedVector = std::vector<T, TrackedAllocator<T, TAG>>;
+
+// clear() keeps a vector's capacity, this hands it back so shutdown leaves nothing allocated
+template <typename V>
+void ReleaseVector(V& values)
+{
+	V().swap(values);
+}
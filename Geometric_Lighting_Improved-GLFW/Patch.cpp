@@ -3,90 +3,63 @@
 #include "RenderShape.h"
 #include "Init_Shader.h"
 #include "InputManager.h"
+#include "Profiler.h"
 
 #include <vector>
+#include <algorithm>
+
+unsigned int Patch::_surfaceUpdates = 0;
 
 Patch::Patch(Shader shader)
 {
-	_transform = Transform();
-	_transform.position = glm::vec3();
-	_transform.rotation = glm::quat();
-	_transform.scale = glm::vec3(1.0f, 1.0f, 1.0f);
-
-	_transform.angularVelocity = glm::quat();
-	_transform.linearVelocity = glm::vec3();
-
-	_transform.rotationOrigin = glm::vec3();
-	_transform.scaleOrigin = glm::vec3();
-
-	GLfloat data = 0.0f;
-	GLint elements = 0;
-	
-	glGenVertexArrays(1, &_vao);
-	glBindVertexArray(_vao);
-
-	glGenBuffers(1, &_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * NUM_VERTS_STORED, &data, GL_DYNAMIC_DRAW);
-
-	glGenBuffers(1, &_ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint) * NUM_ELEMENTS, &elements, GL_DYNAMIC_DRAW);
+	_transform = TransformManager::Create();
+	_surfaceDirty = false;
 
-	// Bind buffer data to shader values
-	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
-	glEnableVertexAttribArray(posAttrib);
-	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+	// Patches sharing a shader are packed into the same vertex and element buffers so they can be batched
+	_geometry = RenderManager::AllocateGeometry(shader, VERTEX_POSITION_NORMAL, NUM_VERTS_TOTAL, NUM_ELEMENTS, _range);
 
-	GLint normAttrib = glGetAttribLocation(shader.shaderPointer, "normal");
-	glEnableVertexAttribArray(normAttrib);
-	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+	_curve = RenderManager::CreateShape(_geometry->vao(), NUM_ELEMENTS, GL_TRIANGLES, shader, glm::vec4(0.6f, 0.6f, 0.6f, 1.0f), _range.firstIndex, _range.baseVertex);
 
-	_curve = new RenderShape(_vao, NUM_ELEMENTS, GL_TRIANGLES, shader, glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
-
-	_curve->transform().parent = &_transform;
-	
-	RenderManager::AddShape(_curve);
+	RenderManager::GetShape(_curve)->transform().parent(_transform);
+	RenderManager::GetShape(_curve)->caster() = CASTER_STATIC;
 
 	GeneratePlane();
 }
 Patch::~Patch()
 {
-	glDeleteBuffers(1, &_vbo);
-	glDeleteVertexArrays(1, &_vao);
-	glDeleteBuffers(1, &_ebo);
 }
 
-void Patch::Update(float dt, bool updateSurface)
+void Patch::Destroy()
 {
-	if (updateSurface)
-		UpdateSurface();
-
-	_transform.position += _transform.linearVelocity * dt;
-	_transform.rotation = glm::slerp(_transform.rotation, _transform.rotation * _transform.angularVelocity, dt);
-
-	glm::mat4 translateMat = glm::translate(glm::mat4(), _transform.position);
-
-	glm::mat4 rotateOriginMat = glm::translate(glm::mat4(), _transform.rotationOrigin);
-	glm::mat4 rotateMat = rotateOriginMat * glm::mat4_cast(_transform.rotation) * glm::inverse(rotateOriginMat);
-
-	glm::mat4 scaleOriginMat = glm::translate(glm::mat4(), _transform.scaleOrigin);
-	glm::mat4 scaleMat = scaleOriginMat * glm::scale(glm::mat4(), _transform.scale) * glm::inverse(scaleOriginMat);
-
-	glm::mat4 *parentModelMat = _transform.parent ? &_transform.parent->modelMat : &glm::mat4();
+	RenderManager::DestroyShape(_curve);
+	TransformManager::Destroy(_transform);
+}
 
-	_transform.modelMat = (*parentModelMat) * (translateMat * scaleMat* rotateMat);
+void Patch::Update(float dt)
+{
+	if (_surfaceDirty)
+		UpdateSurface();
 }
 
 void Patch::SetControlPoint(int controlPointIndex, glm::vec3 newPos)
 {
 	_controlPoints[controlPointIndex] = newPos;
+	_surfaceDirty = true;
 }
 
-Transform& Patch::transform() { return _transform; }
+Transform Patch::transform() { return _transform; }
+
+unsigned int Patch::TakeSurfaceUpdates()
+{
+	unsigned int count = _surfaceUpdates;
+	_surfaceUpdates = 0;
+	return count;
+}
 
 void Patch::UpdateSurface()
 {
+	PROFILE_ZONE("Patch::UpdateSurface");
+
 	GLfloat  inc = 1.0f / ((float)NUM_VERTS - 1.0f);
 	GLfloat t = 0.0f;
 
@@ -156,9 +129,28 @@ void Patch::UpdateSurface()
 			_verts[(j + (i * NUM_VERTS)) * 6 + 5] = normal.z;
 		}
 	}
-	glBindBuffer(GL_VERTEX_ARRAY, _vao);
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(_verts), (void*)&_verts, GL_DYNAMIC_DRAW);
+	RenderManager::QueueUpload(_geometry, _range, _verts);
+
+	// A bezier surface never leaves the hull of its control points, so a sphere around them bounds it
+	glm::vec3 minPoint = _controlPoints[0];
+	glm::vec3 maxPoint = _controlPoints[0];
+	for (int i = 1; i < 16; ++i)
+	{
+		minPoint = glm::min(minPoint, _controlPoints[i]);
+		maxPoint = glm::max(maxPoint, _controlPoints[i]);
+	}
+	glm::vec3 center = (minPoint + maxPoint) * 0.5f;
+	float radius = 0.0f;
+	for (int i = 0; i < 16; ++i)
+	{
+		radius = std::max(radius, glm::length(_controlPoints[i] - center));
+	}
+	RenderShape* shape = RenderManager::GetShape(_curve);
+	shape->bounds() = glm::vec4(center, radius);
+	shape->geometryChanged() = true;
+
+	_surfaceDirty = false;
+	++_surfaceUpdates;
 }
 
 void Patch::GeneratePlane()
@@ -197,11 +189,9 @@ void Patch::GeneratePlane()
 			AddFace(i + j + 1, i + NUM_VERTS + j + 1, i + NUM_VERTS + j, faceNum++);
 		}
 	}
-	glBindBuffer(GL_VERTEX_ARRAY, _vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(_elements), (void*)&_elements, GL_DYNAMIC_DRAW);
+	_geometry->UploadElements(_range, _elements);
 
-	UpdateSurface();
+	_surfaceDirty = true;
 }
 
 void Patch::AddVert(GLfloat x, GLfloat y, GLfloat z, GLfloat u, GLfloat v, int vertNum)
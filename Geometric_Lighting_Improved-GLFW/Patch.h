@@ -1,5 +1,6 @@
 #pragma once
 #include "RenderShape.h"
+#include "GeometryBuffer.h"
 
 #include <GLEW\glew.h>
 #include <GLM\gtc\matrix_transform.hpp>
@@ -7,16 +8,24 @@
 
 class RenderShape;
 
+class Patch;
+typedef Handle<Patch> PatchHandle;
+
 class Patch
 {
 public:
 	Patch(Shader shader);
 	~Patch();
 
-	void Update(float dt, bool updateSurface);
+	void Update(float dt);
+	// Releases the RenderShape and transform owned by this patch, the destructor can't as pools move patches around by value
+	void Destroy();
 
 	void SetControlPoint(int controlPointIndex, glm::vec3 newPos);
-	Transform& transform();
+	Transform transform();
+
+	// Simulation thread, returns how many surfaces were recomputed since the last call
+	static unsigned int TakeSurfaceUpdates();
 private:
 	void UpdateSurface();
 	void GeneratePlane();
@@ -24,17 +33,20 @@ private:
 	void AddFace(GLint a, GLint b, GLint c, int faceNum);
 private:
 	glm::vec3 _controlPoints[16];
-	RenderShape* _curve;
-	GLuint _vao;
-	GLuint _vbo;
-	GLuint _ebo;
+	ShapeHandle _curve;
+	GeometryBuffer* _geometry;
+	GeometryRange _range;
 
 	Transform _transform;
+	bool _surfaceDirty;
 
 	static const int NUM_VERTS = 20;
-	static const int NUM_VERTS_STORED = NUM_VERTS * NUM_VERTS * 6;
+	static const int NUM_VERTS_TOTAL = NUM_VERTS * NUM_VERTS;
+	static const int NUM_VERTS_STORED = NUM_VERTS_TOTAL * 6;
 	static const int NUM_ELEMENTS = (NUM_VERTS - 1) * (NUM_VERTS - 1) * 6;
 
+	static unsigned int _surfaceUpdates;
+
 	GLfloat _verts[NUM_VERTS_STORED];
 	GLuint _elements[NUM_ELEMENTS];
 };
\ No newline at end of file
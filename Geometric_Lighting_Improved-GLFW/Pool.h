@@ -0,0 +1,135 @@
+#pragma once
+#include "MemoryTracker.h"
+#include <utility>
+#include <vector>
+
+// Stable reference to an object in a Pool. The generation is bumped whenever a slot is freed,
+// so a handle to a destroyed object is detected instead of silently pointing at its replacement.
+template <typename T>
+struct Handle
+{
+	unsigned int index;
+	unsigned int generation;
+
+	Handle() : index(0xFFFFFFFF), generation(0) {}
+
+	bool valid() const { return index != 0xFFFFFFFF; }
+	bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Keeps objects densely packed in one array so updates and draws walk contiguous memory.
+// Destroying an object moves the last one into its place, so pointers returned by Get and operator[]
+// are only valid until the next Create or Destroy, hold on to the Handle instead.
+// All storage is charged to TAG in the MemoryTracker.
+template <typename T, MemoryTag TAG = MEM_UNTAGGED>
+class Pool
+{
+public:
+	template <typename... Args>
+	Handle<T> Create(Args&&... args)
+	{
+		unsigned int slot;
+		if (_freeSlots.empty())
+		{
+			slot = _slots.size();
+			_slots.push_back(Slot());
+			_slots[slot].generation = 0;
+		}
+		else
+		{
+			slot = _freeSlots.back();
+			_freeSlots.pop_back();
+		}
+
+		_slots[slot].dense = _items.size();
+		_items.emplace_back(std::forward<Args>(args)...);
+		_denseToSlot.push_back(slot);
+
+		Handle<T> handle;
+		handle.index = slot;
+		handle.generation = _slots[slot].generation;
+		return handle;
+	}
+
+	void Destroy(Handle<T> handle)
+	{
+		if (!Valid(handle))
+			return;
+
+		unsigned int dense = _slots[handle.index].dense;
+		unsigned int last = _items.size() - 1;
+		if (dense != last)
+		{
+			_items[dense] = std::move(_items[last]);
+			_denseToSlot[dense] = _denseToSlot[last];
+			_slots[_denseToSlot[dense]].dense = dense;
+		}
+		_items.pop_back();
+		_denseToSlot.pop_back();
+
+		++_slots[handle.index].generation;
+		_freeSlots.push_back(handle.index);
+	}
+
+	bool Valid(Handle<T> handle) const
+	{
+		return handle.index < _slots.size() && _slots[handle.index].generation == handle.generation;
+	}
+
+	T* Get(Handle<T> handle)
+	{
+		return Valid(handle) ? &_items[_slots[handle.index].dense] : nullptr;
+	}
+
+	// Dense access for iteration, in no particular order
+	unsigned int Size() const { return _items.size(); }
+	T& operator[](unsigned int dense) { return _items[dense]; }
+	// Handle of the object at a dense index, stays the same however the objects get moved around
+	Handle<T> HandleAt(unsigned int dense) const
+	{
+		Handle<T> handle;
+		handle.index = _denseToSlot[dense];
+		handle.generation = _slots[handle.index].generation;
+		return handle;
+	}
+
+	void Reserve(unsigned int count)
+	{
+		_items.reserve(count);
+		_denseToSlot.reserve(count);
+	}
+
+	void Clear()
+	{
+		// Bump every live generation so outstanding handles read as destroyed
+		unsigned int count = _denseToSlot.size();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			++_slots[_denseToSlot[i]].generation;
+			_freeSlots.push_back(_denseToSlot[i]);
+		}
+		_items.clear();
+		_denseToSlot.clear();
+	}
+
+	// Frees all storage. Generations restart, so this is only for shutdown when no handles remain in use
+	void Release()
+	{
+		ReleaseVector(_items);
+		ReleaseVector(_denseToSlot);
+		ReleaseVector(_slots);
+		ReleaseVector(_freeSlots);
+	}
+private:
+	struct Slot
+	{
+		unsigned int dense;
+		unsigned int generation;
+	};
+
+	TrackedVector<T, TAG> _items;
+	TrackedVector<unsigned int, TAG> _denseToSlot;
+	TrackedVector<Slot, TAG> _slots;
+	TrackedVector<unsigned int, TAG> _freeSlots;
+};
@@ -0,0 +1,138 @@
+#include "Profiler.h"
+#include <fstream>
+
+std::atomic<bool> Profiler::_capturing(false);
+std::atomic<unsigned int> Profiler::_generation(0);
+
+std::mutex Profiler::_buffersMutex;
+std::vector<Profiler::ThreadBuffer*> Profiler::_buffers = std::vector<Profiler::ThreadBuffer*>();
+
+const std::chrono::high_resolution_clock::time_point Profiler::_epoch = std::chrono::high_resolution_clock::now();
+
+thread_local Profiler::ThreadBuffer* Profiler::_localBuffer = nullptr;
+thread_local const char* Profiler::_localName = nullptr;
+
+void Profiler::StartCapture()
+{
+	_capturing.store(true, std::memory_order_relaxed);
+}
+
+bool Profiler::StopCapture(const char* path)
+{
+	_capturing.store(false, std::memory_order_relaxed);
+
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	// Complete ("X") events with times in microseconds, plus one metadata event naming each thread
+	file << "{\"traceEvents\":[" << std::endl;
+	bool first = true;
+	{
+		std::lock_guard<std::mutex> lock(_buffersMutex);
+		unsigned int numBuffers = _buffers.size();
+		for (unsigned int i = 0; i < numBuffers; ++i)
+		{
+			ThreadBuffer* buffer = _buffers[i];
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId
+				<< ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+			first = false;
+
+			// A buffer from an earlier capture that its thread has not cleared yet holds nothing from this one
+			unsigned int count = buffer->generation.load() == _generation.load() ? buffer->count.load(std::memory_order_acquire) : 0;
+			for (unsigned int j = 0; j < count; ++j)
+			{
+				const Event& e = buffer->events[j];
+				file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId
+					<< ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+			}
+			if (buffer->dropped)
+			{
+				file << ",\n{\"name\":\"" << buffer->dropped << " events dropped, buffer full\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":" << buffer->threadId
+					<< ",\"ts\":" << (count ? buffer->events[count - 1].end / 1000.0 : 0.0) << "}";
+			}
+		}
+	}
+	file << "\n]}" << std::endl;
+
+	_generation.fetch_add(1);
+	return true;
+}
+
+bool Profiler::capturing()
+{
+	return _capturing.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	_localName = name;
+	if (_localBuffer)
+	{
+		std::lock_guard<std::mutex> lock(_buffersMutex);
+		_localBuffer->name = name;
+	}
+}
+
+long long Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - _epoch).count();
+}
+
+void Profiler::Record(const char* name, long long start, long long end)
+{
+	ThreadBuffer* buffer = LocalBuffer();
+
+	unsigned int generation = _generation.load(std::memory_order_relaxed);
+	if (buffer->generation != generation)
+	{
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->dropped = 0;
+		buffer->generation.store(generation);
+	}
+
+	unsigned int count = buffer->count.load(std::memory_order_relaxed);
+	if (count == EVENTS_PER_THREAD)
+	{
+		++buffer->dropped;
+		return;
+	}
+
+	Event& e = buffer->events[count];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	buffer->count.store(count + 1, std::memory_order_release);
+}
+
+void Profiler::Shutdown()
+{
+	// Only safe once every thread that recorded has finished
+	std::lock_guard<std::mutex> lock(_buffersMutex);
+	unsigned int numBuffers = _buffers.size();
+	for (unsigned int i = 0; i < numBuffers; ++i)
+	{
+		MemoryTracker::Delete(MEM_PROFILER, _buffers[i]);
+	}
+	_buffers.clear();
+	_localBuffer = nullptr;
+}
+
+Profiler::ThreadBuffer* Profiler::LocalBuffer()
+{
+	if (!_localBuffer)
+	{
+		ThreadBuffer* buffer = MemoryTracker::New<ThreadBuffer>(MEM_PROFILER);
+		buffer->events.resize(EVENTS_PER_THREAD);
+		buffer->count = 0;
+		buffer->dropped = 0;
+		buffer->generation = _generation.load();
+
+		std::lock_guard<std::mutex> lock(_buffersMutex);
+		buffer->threadId = _buffers.size();
+		buffer->name = _localName ? _localName : "Thread " + std::to_string(buffer->threadId);
+		_buffers.push_back(buffer);
+		_localBuffer = buffer;
+	}
+	return _localBuffer;
+}
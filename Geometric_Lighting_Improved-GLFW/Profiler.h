@@ -0,0 +1,92 @@
+#pragma once
+#include "MemoryTracker.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Set to 0 to compile every PROFILE_ZONE out entirely
+#ifndef ENABLE_PROFILING
+#define ENABLE_PROFILING 1
+#endif
+
+// Records scoped timing zones from any thread and writes them out in the Chrome Trace Event format,
+// which can be opened in chrome://tracing or ui.perfetto.dev.
+// Each thread appends to its own buffer without locking, recording only happens while capturing.
+class Profiler
+{
+public:
+	static void StartCapture();
+	// Stops recording and writes everything captured since StartCapture, returns false if the file could not be written
+	static bool StopCapture(const char* path);
+	static bool capturing();
+
+	// Name shown for the calling thread in the trace. Only the pointer is kept, so name must outlive the thread
+	static void SetThreadName(const char* name);
+
+	// Nanoseconds since the profiler started
+	static long long Now();
+	static void Record(const char* name, long long start, long long end);
+
+	static void Shutdown();
+private:
+	struct Event
+	{
+		const char* name;
+		long long start;
+		long long end;
+	};
+
+	// Owned by one thread, which is the only one to write events or reset it. Others read up to count.
+	struct ThreadBuffer
+	{
+		TrackedVector<Event, MEM_PROFILER> events;
+		std::atomic<unsigned int> count;
+		unsigned int dropped;
+		std::atomic<unsigned int> generation;
+		unsigned int threadId;
+		std::string name;
+	};
+
+	// Allocates the calling thread's buffer on its first event, so threads that never record while capturing cost nothing
+	static ThreadBuffer* LocalBuffer();
+
+	static const unsigned int EVENTS_PER_THREAD = 1 << 18;
+
+	static std::atomic<bool> _capturing;
+	// Bumped after every capture, each thread clears its own buffer when it sees a new generation
+	static std::atomic<unsigned int> _generation;
+
+	static std::mutex _buffersMutex;
+	static std::vector<ThreadBuffer*> _buffers;
+
+	// The calling thread's buffer once it has one, and the name it was given before then
+	static thread_local ThreadBuffer* _localBuffer;
+	static thread_local const char* _localName;
+
+	static const std::chrono::high_resolution_clock::time_point _epoch;
+};
+
+// Times the enclosing scope
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name) : _name(name), _start(Profiler::capturing() ? Profiler::Now() : -1) {}
+	~ProfileZone()
+	{
+		if (_start >= 0)
+			Profiler::Record(_name, _start, Profiler::Now());
+	}
+private:
+	const char* _name;
+	long long _start;
+};
+
+#if ENABLE_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
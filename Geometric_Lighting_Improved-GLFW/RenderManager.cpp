@@ -1,46 +1,545 @@
 #include "RenderManager.h"
+#include "FramePacket.h"
 #include "RenderShape.h"
+#include "CameraManager.h"
 #include "Init_Shader.h"
 #include "InputManager.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
 #include <GLM\gtc\random.hpp>
+#include <algorithm>
+#include <iostream>
 
-std::vector<RenderShape*> RenderManager::_shapes = std::vector<RenderShape*>();
+Pool<RenderShape, MEM_RENDER> RenderManager::_shapes = Pool<RenderShape, MEM_RENDER>();
+std::vector<GeometryBuffer*> RenderManager::_geometry = std::vector<GeometryBuffer*>();
 
-void RenderManager::AddShape(Shader shader, GLuint vao, GLenum type, GLsizei count, glm::vec4 color, Transform transform)
+TrackedVector<RenderShape*, MEM_RENDER> RenderManager::_drawList = TrackedVector<RenderShape*, MEM_RENDER>();
+
+TrackedVector<BufferUpload, MEM_FRAME_PACKETS> RenderManager::_pendingUploads = TrackedVector<BufferUpload, MEM_FRAME_PACKETS>();
+TrackedVector<GLfloat, MEM_FRAME_PACKETS> RenderManager::_pendingUploadData = TrackedVector<GLfloat, MEM_FRAME_PACKETS>();
+
+RenderStats RenderManager::_stats = RenderStats();
+RenderStats RenderManager::_intervalStats = RenderStats();
+unsigned int RenderManager::_framesSinceLog = 0;
+unsigned int RenderManager::_logInterval = 600;
+
+GLuint RenderManager::_indirectBuffer = 0;
+GLuint RenderManager::_emptyVao = 0;
+GLuint RenderManager::_drawDataBuffer = 0;
+
+Shader RenderManager::_depthShader = Shader();
+
+const GLuint DrawData::ALL_LIGHTS;
+
+TrackedVector<RenderManager::StaticCaster, MEM_RENDER> RenderManager::_staticCasters;
+unsigned int RenderManager::_numStaticCasters = 0;
+unsigned int RenderManager::_casterFrame = 0;
+unsigned int RenderManager::_staticCasterVersion = 0;
+
+const float RenderManager::SHADING_LOD_HYSTERESIS = 1.25f;
+float RenderManager::_lodPixels = 0.0f;
+int RenderManager::_lodViewportHeight = 1;
+
+const char* RenderManager::PASS_NAMES[NUM_RENDER_PASSES] = { "opaque", "gizmos" };
+
+// Shapes in the same pass that share a program, vertex array and primitive mode can be submitted in one multi-draw
+static bool SameBatch(RenderShape* a, RenderShape* b)
+{
+	return a->pass() == b->pass() && a->caster() == b->caster() && a->shading() == b->shading() && a->shader().shaderPointer == b->shader().shaderPointer && a->vao() == b->vao() && a->mode() == b->mode();
+}
+
+static bool BatchOrder(RenderShape* a, RenderShape* b)
+{
+	if (a->pass() != b->pass())
+		return a->pass() < b->pass();
+	if (a->caster() != b->caster())
+		return a->caster() < b->caster();
+	if (a->shading() != b->shading())
+		return a->shading() < b->shading();
+	if (a->shader().shaderPointer != b->shader().shaderPointer)
+		return a->shader().shaderPointer < b->shader().shaderPointer;
+	if (a->vao() != b->vao())
+		return a->vao() < b->vao();
+	return a->mode() < b->mode();
+}
+
+// World space bounding sphere of the shape, the radius grows with the largest scale along any axis so the sphere stays around it
+static glm::vec4 WorldBounds(RenderShape& shape)
+{
+	const glm::mat4& modelMat = shape.transform().renderMat();
+	const glm::vec4& bounds = shape.bounds();
+	glm::vec4 center = modelMat * glm::vec4(bounds.x, bounds.y, bounds.z, 1.0f);
+	float scale = std::max(glm::length(glm::vec3(modelMat[0])), std::max(glm::length(glm::vec3(modelMat[1])), glm::length(glm::vec3(modelMat[2]))));
+	return glm::vec4(center.x, center.y, center.z, bounds.w < 0.0f ? -1.0f : bounds.w * scale);
+}
+
+ShapeHandle RenderManager::CreateShape(GLint vao, GLsizei count, GLenum mode, Shader shader, glm::vec4 color, GLuint firstIndex, GLint baseVertex)
+{
+	return _shapes.Create(vao, count, mode, shader, color, firstIndex, baseVertex);
+}
+
+RenderShape* RenderManager::GetShape(ShapeHandle shape)
+{
+	return _shapes.Get(shape);
+}
+
+void RenderManager::DestroyShape(ShapeHandle shape)
+{
+	RenderShape* toDestroy = _shapes.Get(shape);
+	if (toDestroy)
+		TransformManager::Destroy(toDestroy->transform());
+	_shapes.Destroy(shape);
+}
+
+GeometryBuffer* RenderManager::AllocateGeometry(Shader shader, VertexFormat format, GLsizei numVerts, GLsizei numElements, GeometryRange& range)
+{
+	unsigned int numBuffers = _geometry.size();
+	for (unsigned int i = 0; i < numBuffers; ++i)
+	{
+		if (_geometry[i]->program() == shader.shaderPointer && _geometry[i]->format() == format && _geometry[i]->Allocate(numVerts, numElements, range))
+			return _geometry[i];
+	}
+
+	GLsizei maxVerts = std::max(numVerts, GEOMETRY_BUFFER_VERTS);
+	GLsizei maxElements = std::max(numElements, GEOMETRY_BUFFER_ELEMENTS);
+	GeometryBuffer* geometry = MemoryTracker::New<GeometryBuffer>(MEM_GEOMETRY, shader, format, maxVerts, maxElements);
+	geometry->Allocate(numVerts, numElements, range);
+	_geometry.push_back(geometry);
+	return geometry;
+}
+
+GeometryBuffer* RenderManager::FindGeometry(GLuint vao)
 {
-	_shapes.push_back(new RenderShape(vao, count, type, shader, color));
-	_shapes[_shapes.size() - 1]->transform() = transform;
+	unsigned int numBuffers = _geometry.size();
+	for (unsigned int i = 0; i < numBuffers; ++i)
+	{
+		if (_geometry[i]->vao() == vao)
+			return _geometry[i];
+	}
+	return nullptr;
 }
 
-void RenderManager::AddShape(RenderShape* shape)
+void RenderManager::QueueUpload(GeometryBuffer* geometry, const GeometryRange& range, const GLfloat* verts)
 {
-	_shapes.push_back(shape);
+	BufferUpload upload;
+	upload.geometry = geometry;
+	upload.range = range;
+	upload.dataOffset = _pendingUploadData.size();
+	_pendingUploads.push_back(upload);
+
+	_pendingUploadData.insert(_pendingUploadData.end(), verts, verts + range.numVerts * geometry->vertexSize());
 }
 
 void RenderManager::Update(float dt)
 {
-	unsigned int numShapes = _shapes.size();
+	PROFILE_ZONE("RenderManager::Update");
+
+	unsigned int numShapes = _shapes.Size();
 	for (unsigned int i = 0; i < numShapes; ++i)
 	{
-		_shapes[i]->Update(dt);
+		_shapes[i].Update(dt);
 	}
 }
 
-void RenderManager::Draw()
+void RenderManager::BuildFrame(FramePacket& packet)
 {
-	unsigned int numShapes = _shapes.size();
+	PROFILE_ZONE("RenderManager::BuildFrame");
+
+	packet.viewMat = CameraManager::ViewMat();
+	packet.projMat = CameraManager::ProjMat();
+	packet.camPos = CameraManager::CamPos();
+
+	// Hand over the uploads queued since the last packet, the swap gives the packet's old storage back to the queue
+	packet.uploads.swap(_pendingUploads);
+	packet.uploadData.swap(_pendingUploadData);
+	_pendingUploads.clear();
+	_pendingUploadData.clear();
+
+	// Gather the visible shapes and sort them so that each batch is contiguous, shading is part of the batch so it is chosen first.
+	// Static casters are compared against the last frame built by handle, so cached shadows are only redrawn when one changed
+	_drawList.clear();
+	float pixelsPerUnit = packet.projMat[1][1] * _lodViewportHeight * 0.5f;
+	unsigned int numShapes = _shapes.Size();
+	unsigned int numStatic = 0;
+	bool castersChanged = false;
+	++_casterFrame;
 	for (unsigned int i = 0; i < numShapes; ++i)
 	{
-		_shapes[i]->Draw();
+		RenderShape& shape = _shapes[i];
+		if (!shape.active())
+			continue;
+
+		ChooseShading(shape, packet.viewMat, pixelsPerUnit);
+		_drawList.push_back(&shape);
+
+		if (shape.caster() == CASTER_STATIC)
+		{
+			ShapeHandle handle = _shapes.HandleAt(i);
+			if (handle.index >= _staticCasters.size())
+				_staticCasters.resize(handle.index + 1, StaticCaster());
+
+			StaticCaster& built = _staticCasters[handle.index];
+			const glm::mat4& modelMat = shape.transform().renderMat();
+			if (built.frame != _casterFrame - 1 || built.shape != handle || built.modelMat != modelMat || shape.geometryChanged())
+				castersChanged = true;
+			built.shape = handle;
+			built.modelMat = modelMat;
+			built.frame = _casterFrame;
+			++numStatic;
+		}
+	}
+	if (numStatic != _numStaticCasters)
+		castersChanged = true;
+	_numStaticCasters = numStatic;
+	if (castersChanged)
+		++_staticCasterVersion;
+	packet.staticCasterVersion = _staticCasterVersion;
+	std::sort(_drawList.begin(), _drawList.end(), BatchOrder);
+
+	// Matrices are combined once per shape here rather than once per vertex on the GPU
+	glm::mat4 viewProjMat = packet.projMat * packet.viewMat;
+
+	unsigned int numDraws = _drawList.size();
+	packet.commands.resize(numDraws);
+	packet.drawData.resize(numDraws);
+	packet.drawBounds.resize(numDraws);
+	packet.batches.clear();
+	for (unsigned int i = 0; i < numDraws; ++i)
+	{
+		RenderShape* shape = _drawList[i];
+
+		packet.commands[i].count = shape->count();
+		packet.commands[i].instanceCount = 1;
+		packet.commands[i].firstIndex = shape->firstIndex();
+		packet.commands[i].baseVertex = shape->baseVertex();
+		packet.commands[i].baseInstance = 0;
+
+		const glm::mat4& modelMat = shape->transform().renderMat();
+		packet.drawData[i].mvpMat = viewProjMat * modelMat;
+		packet.drawData[i].modelMat = modelMat;
+		packet.drawData[i].normalMat = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(modelMat))));
+		packet.drawData[i].color = shape->currentColor();
+		packet.drawData[i].lightRange = glm::uvec2(0, DrawData::ALL_LIGHTS);
+
+		packet.drawBounds[i] = WorldBounds(*shape);
+
+		shape->geometryChanged() = false;
+
+		if (i == 0 || !SameBatch(_drawList[i - 1], shape))
+		{
+			DrawBatch batch;
+			batch.pass = shape->pass();
+			batch.caster = shape->caster();
+			batch.shading = shape->shading();
+			batch.shader = shape->shader();
+			batch.vao = shape->vao();
+			batch.mode = shape->mode();
+			batch.first = i;
+			batch.count = 0;
+			packet.batches.push_back(batch);
+		}
+		++packet.batches.back().count;
+	}
+}
+
+void RenderManager::ChooseShading(RenderShape& shape, const glm::mat4& viewMat, float pixelsPerUnit)
+{
+	glm::vec4 bounds = WorldBounds(shape);
+	if (_lodPixels <= 0.0f || shape.pass() != PASS_OPAQUE || bounds.w < 0.0f)
+	{
+		shape.shading() = SHADING_PIXEL;
+		return;
+	}
+
+	// With the camera inside the bounds the shape can cover the whole screen
+	float depth = -(viewMat * glm::vec4(bounds.x, bounds.y, bounds.z, 1.0f)).z;
+	if (depth <= bounds.w)
+	{
+		shape.shading() = SHADING_PIXEL;
+		return;
+	}
+
+	float pixels = 2.0f * bounds.w * pixelsPerUnit / depth;
+	float threshold = shape.shading() == SHADING_VERTEX ? _lodPixels * SHADING_LOD_HYSTERESIS : _lodPixels;
+	shape.shading() = pixels < threshold ? SHADING_VERTEX : SHADING_PIXEL;
+}
+
+void RenderManager::BeginFrame()
+{
+	_stats = RenderStats();
+}
+
+void RenderManager::Upload(const FramePacket& packet)
+{
+	PROFILE_ZONE("RenderManager::Upload");
+
+	if (!_indirectBuffer)
+		InitBuffers();
+
+	_stats.patchesRetessellated += packet.patchesRetessellated;
+
+	GpuProfiler::BeginPass("uploads");
+	unsigned int numUploads = packet.uploads.size();
+	for (unsigned int i = 0; i < numUploads; ++i)
+	{
+		const BufferUpload& upload = packet.uploads[i];
+		upload.geometry->UploadVerts(upload.range, &packet.uploadData[upload.dataOffset]);
+
+		++_stats.bufferUploads;
+		_stats.bytesUploaded += sizeof(GLfloat) * upload.range.numVerts * upload.geometry->vertexSize();
+	}
+
+	unsigned int numDraws = packet.commands.size();
+	if (numDraws == 0)
+	{
+		GpuProfiler::EndPass();
+		return;
+	}
+
+	// Upload all commands and per-draw values for the frame at once, orphaning last frame's storage
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * numDraws, &packet.commands[0], GL_STREAM_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _indirectBuffer, sizeof(DrawElementsIndirectCommand) * numDraws, "draw commands");
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawData) * numDraws, &packet.drawData[0], GL_STREAM_DRAW);
+	MemoryTracker::TrackGL(GL_BUFFER, _drawDataBuffer, sizeof(DrawData) * numDraws, "draw data");
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, _drawDataBuffer);
+	RecordUpload(sizeof(DrawElementsIndirectCommand) * numDraws);
+	RecordUpload(sizeof(DrawData) * numDraws);
+	GpuProfiler::EndPass();
+}
+
+void RenderManager::DrawPass(const FramePacket& packet, RenderPass pass, const Shader* shader, const Shader* (*vertexLit)())
+{
+	PROFILE_ZONE("RenderManager::DrawPass");
+
+	// Batches are sorted by pass, so the pass's batches are one contiguous run
+	unsigned int numBatches = packet.batches.size();
+	unsigned int first = 0;
+	while (first < numBatches && packet.batches[first].pass < pass)
+		++first;
+	if (first == numBatches || packet.batches[first].pass != pass)
+		return;
+
+	GpuProfiler::BeginPass(PASS_NAMES[pass]);
+
+	// Whatever was bound before the first batch is unknown, so it is always bound
+	GLint boundProgram = -1;
+	GLuint boundVao = 0;
+	const Shader* vertexLitShader = nullptr;
+	for (unsigned int i = first; i < numBatches && packet.batches[i].pass == pass; ++i)
+	{
+		const DrawBatch& batch = packet.batches[i];
+		if (vertexLit && batch.shading == SHADING_VERTEX)
+		{
+			if (!vertexLitShader)
+				vertexLitShader = vertexLit();
+			SubmitBatch(packet, batch, *vertexLitShader, boundProgram, boundVao);
+		}
+		else
+			SubmitBatch(packet, batch, shader ? *shader : batch.shader, boundProgram, boundVao);
+	}
+	GpuProfiler::EndPass();
+}
+
+void RenderManager::DrawDepth(const FramePacket& packet, RenderPass pass)
+{
+	PROFILE_ZONE("RenderManager::DrawDepth");
+
+	if (!_depthShader.shaderPointer)
+	{
+		char* shaders[] = { "depth_vert.glsl" };
+		GLenum types[] = { GL_VERTEX_SHADER };
+		_depthShader.shaderPointer = initShaders(shaders, types, 1);
+		_depthShader.uCamPos = -1;
+		_depthShader.uDrawOffset = glGetUniformLocation(_depthShader.shaderPointer, "drawOffset");
+	}
+
+	GpuProfiler::BeginPass("depth prepass");
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	GLint boundProgram = -1;
+	GLuint boundVao = 0;
+	unsigned int numBatches = packet.batches.size();
+	for (unsigned int i = 0; i < numBatches; ++i)
+	{
+		const DrawBatch& batch = packet.batches[i];
+		if (batch.pass == pass)
+			SubmitBatch(packet, batch, _depthShader, boundProgram, boundVao);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	GpuProfiler::EndPass();
+}
+
+void RenderManager::DrawCasters(const FramePacket& packet, ShadowCaster caster, const Shader& shader)
+{
+	PROFILE_ZONE("RenderManager::DrawCasters");
+
+	GLint boundProgram = -1;
+	GLuint boundVao = 0;
+	unsigned int numBatches = packet.batches.size();
+	for (unsigned int i = 0; i < numBatches; ++i)
+	{
+		const DrawBatch& batch = packet.batches[i];
+		if (batch.caster == caster && batch.mode == GL_TRIANGLES)
+			SubmitBatch(packet, batch, shader, boundProgram, boundVao);
+	}
+}
+
+void RenderManager::SubmitBatch(const FramePacket& packet, const DrawBatch& batch, const Shader& shader, GLint& boundProgram, GLuint& boundVao)
+{
+	// Batches are also sorted by program, the camera position only needs setting when it changes
+	if (shader.shaderPointer != boundProgram)
+	{
+		glUseProgram(shader.shaderPointer);
+		++_stats.programBinds;
+		if (shader.uCamPos >= 0)
+		{
+			glUniform4fv(shader.uCamPos, 1, glm::value_ptr(packet.camPos));
+			++_stats.uniformUploads;
+		}
+		boundProgram = shader.shaderPointer;
+	}
+	// No batch uses vertex array 0, so the first batch always binds its own
+	if (batch.vao != boundVao)
+	{
+		glBindVertexArray(batch.vao);
+		boundVao = batch.vao;
+		++_stats.vaoBinds;
+	}
+
+	glUniform1i(shader.uDrawOffset, batch.first);
+	++_stats.uniformUploads;
+
+	//Make draw call
+	glMultiDrawElementsIndirect(batch.mode, GL_UNSIGNED_INT, (void*)(sizeof(DrawElementsIndirectCommand) * batch.first), batch.count, 0);
+
+	++_stats.drawCalls;
+	_stats.draws += batch.count;
+	if (batch.mode == GL_TRIANGLES)
+	{
+		for (unsigned int j = batch.first; j < batch.first + batch.count; ++j)
+		{
+			_stats.triangles += packet.commands[j].count / 3 * packet.commands[j].instanceCount;
+		}
+	}
+}
+
+void RenderManager::Draw(const FramePacket& packet)
+{
+	Upload(packet);
+	for (unsigned int i = 0; i < NUM_RENDER_PASSES; ++i)
+	{
+		DrawPass(packet, (RenderPass)i);
+	}
+}
+
+void RenderManager::RecordDrawCall(unsigned int draws, unsigned long long triangles)
+{
+	++_stats.drawCalls;
+	_stats.draws += draws;
+	_stats.triangles += triangles;
+}
+
+void RenderManager::RecordStateChanges(unsigned int programBinds, unsigned int uniformUploads)
+{
+	_stats.programBinds += programBinds;
+	_stats.uniformUploads += uniformUploads;
+}
+
+void RenderManager::RecordUpload(size_t bytes)
+{
+	++_stats.bufferUploads;
+	_stats.bytesUploaded += bytes;
+}
+
+GLuint RenderManager::commandBuffer()
+{
+	return _indirectBuffer;
+}
+
+GLuint RenderManager::emptyVao()
+{
+	if (!_emptyVao)
+		glGenVertexArrays(1, &_emptyVao);
+	return _emptyVao;
+}
+
+const RenderStats& RenderManager::stats()
+{
+	return _stats;
+}
+
+void RenderManager::SetLogInterval(unsigned int frames)
+{
+	_logInterval = frames;
+	_framesSinceLog = 0;
+	_intervalStats = RenderStats();
+}
+
+void RenderManager::SetShadingLod(float pixels, int viewportHeight)
+{
+	_lodPixels = pixels;
+	_lodViewportHeight = viewportHeight;
+}
+
+void RenderManager::LogStats()
+{
+	if (_framesSinceLog == 0)
+		return;
+
+	double frames = _framesSinceLog;
+	std::cout << "Render stats (per frame, average over " << _framesSinceLog << " frames)" << std::endl;
+	std::cout << "  draw calls " << _intervalStats.drawCalls / frames << ", shapes " << _intervalStats.draws / frames << ", triangles " << _intervalStats.triangles / frames << std::endl;
+	std::cout << "  program binds " << _intervalStats.programBinds / frames << ", VAO binds " << _intervalStats.vaoBinds / frames << ", uniform uploads " << _intervalStats.uniformUploads / frames << std::endl;
+	std::cout << "  buffer uploads " << _intervalStats.bufferUploads / frames << ", KB uploaded " << _intervalStats.bytesUploaded / frames / 1024.0 << ", patches retessellated " << _intervalStats.patchesRetessellated / frames << std::endl;
+}
+
+void RenderManager::EndFrame()
+{
+	_intervalStats += _stats;
+	++_framesSinceLog;
+	if (_logInterval && _framesSinceLog >= _logInterval)
+	{
+		LogStats();
+		_intervalStats = RenderStats();
+		_framesSinceLog = 0;
 	}
 }
 
 void RenderManager::DumpData()
 {
+	_shapes.Release();
+	ReleaseVector(_drawList);
+	ReleaseVector(_staticCasters);
+	ReleaseVector(_pendingUploads);
+	ReleaseVector(_pendingUploadData);
+
 	unsigned int i;
-	while (i = _shapes.size())
+	while (i = _geometry.size())
 	{
-		delete _shapes[i - 1];
-		_shapes.pop_back();
+		MemoryTracker::Delete(MEM_GEOMETRY, _geometry[i - 1]);
+		_geometry.pop_back();
 	}
+
+	MemoryTracker::UntrackGL(GL_BUFFER, _indirectBuffer);
+	MemoryTracker::UntrackGL(GL_BUFFER, _drawDataBuffer);
+	glDeleteBuffers(1, &_indirectBuffer);
+	glDeleteBuffers(1, &_drawDataBuffer);
+	_indirectBuffer = 0;
+	_drawDataBuffer = 0;
+	glDeleteVertexArrays(1, &_emptyVao);
+	_emptyVao = 0;
+
+	glDeleteProgram(_depthShader.shaderPointer);
+	_depthShader.shaderPointer = 0;
+}
+
+void RenderManager::InitBuffers()
+{
+	glGenBuffers(1, &_indirectBuffer);
+	glGenBuffers(1, &_drawDataBuffer);
 }
@@ -2,25 +2,210 @@
 #include <GLEW\glew.h>
 #include <GLM\gtc\matrix_transform.hpp>
 #include <vector>
+#include "GeometryBuffer.h"
+#include "RenderShape.h"
+#include "Pool.h"
 
-struct Transform;
-struct Shader;
-class RenderShape;
+// Layout of GL_DRAW_INDIRECT_BUFFER entries consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Per-draw values read in the vertex shader through gl_DrawID, matches DrawData in the shaders (std430)
+struct DrawData
+{
+	glm::mat4 mvpMat;
+	glm::mat4 modelMat;
+	// Inverse transpose of the model matrix's upper 3x3, std430 pads each mat3 column to a vec4
+	glm::mat3x4 normalMat;
+	glm::vec4 color;
+	// Offset into the object light indices and number of lights reaching the shape, filled in by LightingManager::BuildFrame.
+	// A count of ALL_LIGHTS leaves the shape lit by its clusters alone
+	glm::uvec2 lightRange;
+	// std430 rounds the struct up to a multiple of its largest member alignment
+	glm::uvec2 padding;
+
+	static const GLuint ALL_LIGHTS = ~0u;
+};
+
+// A run of draws that share a program, vertex array and primitive mode and go out in one multi-draw
+struct DrawBatch
+{
+	RenderPass pass;
+	ShadowCaster caster;
+	ShadingLod shading;
+	Shader shader;
+	GLuint vao;
+	GLenum mode;
+	unsigned int first;
+	unsigned int count;
+};
+
+// Vertex data produced by the simulation that still has to be copied into a GeometryBuffer,
+// dataOffset indexes the float array sent alongside it
+struct BufferUpload
+{
+	GeometryBuffer* geometry;
+	GeometryRange range;
+	unsigned int dataOffset;
+};
+
+// Counts for the last frame drawn
+struct RenderStats
+{
+	// glMultiDrawElementsIndirect calls, and the shapes they drew
+	unsigned int drawCalls;
+	unsigned int draws;
+	unsigned long long triangles;
+
+	// State changes actually issued, binds of what is already bound are skipped
+	unsigned int programBinds;
+	unsigned int vaoBinds;
+	unsigned int uniformUploads;
+
+	// Buffer writes, and the bytes they sent through glBufferData and glBufferSubData
+	unsigned int bufferUploads;
+	unsigned long long bytesUploaded;
+
+	// Patches whose surface was recomputed since the previous frame
+	unsigned int patchesRetessellated;
+
+	RenderStats& operator+=(const RenderStats& other)
+	{
+		drawCalls += other.drawCalls;
+		draws += other.draws;
+		triangles += other.triangles;
+		programBinds += other.programBinds;
+		vaoBinds += other.vaoBinds;
+		uniformUploads += other.uniformUploads;
+		bufferUploads += other.bufferUploads;
+		bytesUploaded += other.bytesUploaded;
+		patchesRetessellated += other.patchesRetessellated;
+		return *this;
+	}
+};
+
+struct FramePacket;
 
 class RenderManager
 {
 public:
-	static void AddShape(Shader shader, GLuint vao, GLenum type, GLsizei count, glm::vec4 color, Transform transform);
-	
-	static void AddShape(RenderShape* shape);
+	static ShapeHandle CreateShape(GLint vao, GLsizei count, GLenum mode, Shader shader, glm::vec4 color, GLuint firstIndex = 0, GLint baseVertex = 0);
+	static RenderShape* GetShape(ShapeHandle shape);
+	static void DestroyShape(ShapeHandle shape);
+
+	static GeometryBuffer* AllocateGeometry(Shader shader, VertexFormat format, GLsizei numVerts, GLsizei numElements, GeometryRange& range);
+	// The GeometryBuffer owning a vertex array, nullptr for vertex arrays created elsewhere
+	static GeometryBuffer* FindGeometry(GLuint vao);
+
+	// Queues vertex data to be copied into a GeometryBuffer by the render thread with the next frame packet
+	static void QueueUpload(GeometryBuffer* geometry, const GeometryRange& range, const GLfloat* verts);
 
 	static void Update(float dt);
 
-	static void Draw();
+	// Simulation thread, records everything needed to draw the current state of the scene
+	static void BuildFrame(FramePacket& packet);
+	// Render thread, resets the counters for a new frame, called before anything is bound
+	static void BeginFrame();
+	// Render thread, copies the packet's vertex data, draw commands and per-draw values into GL, before any pass is drawn
+	static void Upload(const FramePacket& packet);
+	// Render thread, draws every batch of one pass. shader, when given, replaces the program of every batch, and the program
+	// vertexLit returns replaces it again for batches of shapes lit per vertex. vertexLit is only called once such a batch comes up,
+	// so its program need not exist until then. Both must take the same vertex attributes and read the same per-draw buffer
+	static void DrawPass(const FramePacket& packet, RenderPass pass, const Shader* shader = nullptr, const Shader* (*vertexLit)() = nullptr);
+	// Render thread, draws every batch of one pass into depth alone with a position only program and no fragment shader.
+	// Drawing the pass again with the depth test at GL_EQUAL and depth writes off then shades each pixel once
+	static void DrawDepth(const FramePacket& packet, RenderPass pass);
+	// Render thread, draws every triangle batch of the given casters with shader, which must read the same vertex attributes
+	// and per-draw buffer as the shapes' own
+	static void DrawCasters(const FramePacket& packet, ShadowCaster caster, const Shader& shader);
+	// Render thread, uploads then draws every pass with its own shaders
+	static void Draw(const FramePacket& packet);
+	// Render thread, adds the frame's counts to the logging interval once everything has been drawn
+	static void EndFrame();
+	// Lets other systems that bind programs or upload uniforms on the render thread add to the frame's counts
+	static void RecordStateChanges(unsigned int programBinds, unsigned int uniformUploads);
+	// Counts a draw call issued outside of DrawPass
+	static void RecordDrawCall(unsigned int draws, unsigned long long triangles);
+	// Counts one buffer write of the given size
+	static void RecordUpload(size_t bytes);
+	static const RenderStats& stats();
+	// Holds the commands of the last packet uploaded, in the order of its commands and drawData
+	static GLuint commandBuffer();
+	// Render thread, a vertex array with nothing in it, for full screen passes whose vertex shader makes up its own triangle but
+	// still needs a vertex array bound. Created the first time it is asked for
+	static GLuint emptyVao();
+
+	// Logs per frame averages every this many frames, 0 turns logging off
+	static void SetLogInterval(unsigned int frames);
+	static void LogStats();
+
+	// Opaque shapes with bounds narrower on screen than this many pixels, on a viewport the given height, are lit per vertex.
+	// They only go back to per pixel lighting once SHADING_LOD_HYSTERESIS times wider, so shapes near the threshold don't flicker
+	// between the two. 0, the default, lights every shape per pixel
+	static void SetShadingLod(float pixels, int viewportHeight);
+	static const float SHADING_LOD_HYSTERESIS;
 
 	static void DumpData();
 
+	// Shader storage binding point of the per-draw buffer, must match the binding in the vertex shaders
+	static const GLuint DRAW_DATA_BINDING = 0;
+
+	// Names the passes are reported under by the GpuProfiler
+	static const char* PASS_NAMES[NUM_RENDER_PASSES];
+
 private:
+	static void InitBuffers();
+	// Binds what the batch needs unless it is already bound, then submits it in one multi-draw
+	static void SubmitBatch(const FramePacket& packet, const DrawBatch& batch, const Shader& shader, GLint& boundProgram, GLuint& boundVao);
+	// Picks per pixel or per vertex lighting for the shape, pixelsPerUnit is the width on screen of a unit at a view depth of 1
+	static void ChooseShading(RenderShape& shape, const glm::mat4& viewMat, float pixelsPerUnit);
+
+	static const GLsizei GEOMETRY_BUFFER_VERTS = 1 << 16;
+	static const GLsizei GEOMETRY_BUFFER_ELEMENTS = 1 << 18;
+
+	static Pool<RenderShape, MEM_RENDER> _shapes;
+	static std::vector<GeometryBuffer*> _geometry;
+
+	static TrackedVector<RenderShape*, MEM_RENDER> _drawList;
+
+	// A static caster as it was in the last frame built
+	struct StaticCaster
+	{
+		ShapeHandle shape;
+		glm::mat4 modelMat;
+		// Number of the last frame built that had the shape as a static caster
+		unsigned int frame;
+	};
+
+	// Static casters by the index of their shape's handle, so reordering the draws leaves them alone, with how many there were
+	// in the last frame built, that frame's number and a version bumped whenever any of them changed
+	static TrackedVector<StaticCaster, MEM_RENDER> _staticCasters;
+	static unsigned int _numStaticCasters;
+	static unsigned int _casterFrame;
+	static unsigned int _staticCasterVersion;
+
+	static float _lodPixels;
+	static int _lodViewportHeight;
+
+	static TrackedVector<BufferUpload, MEM_FRAME_PACKETS> _pendingUploads;
+	static TrackedVector<GLfloat, MEM_FRAME_PACKETS> _pendingUploadData;
+
+	static RenderStats _stats;
+	// Sums over the frames since stats were last logged
+	static RenderStats _intervalStats;
+	static unsigned int _framesSinceLog;
+	static unsigned int _logInterval;
+
+	static GLuint _indirectBuffer;
+	static GLuint _emptyVao;
+	static GLuint _drawDataBuffer;
 
-	static std::vector<RenderShape*> _shapes;
+	// Compiled the first time a depth prepass is drawn
+	static Shader _depthShader;
 };
@@ -1,16 +1,23 @@
 #include "RenderShape.h"
-#include "CameraManager.h"
 
-RenderShape::RenderShape(GLint vao, GLsizei count, GLenum mode, Shader shader, glm::vec4 color)
+RenderShape::RenderShape(GLint vao, GLsizei count, GLenum mode, Shader shader, glm::vec4 color, GLuint firstIndex, GLint baseVertex)
 {
 	_vao = vao;
 	_count = count;
+	_firstIndex = firstIndex;
+	_baseVertex = baseVertex;
 	_mode = mode;
 	_shader = shader;
 	_color = color;
 	_currentColor = color;
-
-	_transform = Transform();
+	_active = true;
+	_pass = PASS_OPAQUE;
+	_bounds = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	_caster = CASTER_NONE;
+	_geometryChanged = false;
+	_shading = SHADING_PIXEL;
+
+	_transform = TransformManager::Create();
 }
 RenderShape::~RenderShape()
 {
@@ -19,49 +26,9 @@ RenderShape::~RenderShape()
 
 void RenderShape::Update(float dt)
 {
-	// Update values
-	_transform.position += _transform.linearVelocity * dt;
-	_transform.rotation = glm::slerp(_transform.rotation, _transform.rotation * _transform.angularVelocity, dt);
-
-	// Apply transforms
-	glm::mat4 translateMat = glm::translate(glm::mat4(), _transform.position);
-
-	glm::mat4 rotateOriginMat = glm::translate(glm::mat4(), _transform.rotationOrigin);
-	glm::mat4 rotateMat = rotateOriginMat * glm::mat4_cast(_transform.rotation) * glm::inverse(rotateOriginMat);
-
-	glm::mat4 scaleOriginMat = glm::translate(glm::mat4(), _transform.scaleOrigin);
-	glm::mat4 scaleMat = scaleOriginMat * glm::scale(glm::mat4(), _transform.scale) * glm::inverse(scaleOriginMat);
-
-	glm::mat4 *parentModelMat = _transform.parent ? &_transform.parent->modelMat : &glm::mat4();
-
-	_transform.modelMat = (*parentModelMat) * (translateMat * scaleMat* rotateMat);
-
+	// Model matrices are computed for every transform at once by the TransformManager
 	_currentColor = _color;
 }
-void RenderShape::Draw()
-{
-	if (_active)
-	{
-		glBindVertexArray(_vao);
-
-		glUseProgram(_shader.shaderPointer);
-
-		glm::mat4 modelMat = _transform.modelMat;
-		glm::mat4 viewMat = CameraManager::ViewMat();
-		glm::mat4 projMat = CameraManager::ProjMat();
-		glm::vec4 camPos = CameraManager::CamPos();
-
-		glUniformMatrix4fv(_shader.uModelMat, 1, GL_FALSE, glm::value_ptr(modelMat));
-		glUniformMatrix4fv(_shader.uViewMat, 1, GL_FALSE, glm::value_ptr(viewMat));
-		glUniformMatrix4fv(_shader.uProjMat, 1, GL_FALSE, glm::value_ptr(projMat));
-		glUniform4fv(_shader.uColor, 1, glm::value_ptr(_currentColor));
-		glUniform4fv(_shader.uCamPos, 1, glm::value_ptr(camPos));
-
-		//Make draw call
-		glDrawElements(_mode, _count, GL_UNSIGNED_INT, 0);
-	}
-}
-
 const glm::vec4& RenderShape::color()
 {
 	return _color;
@@ -70,7 +37,7 @@ glm::vec4& RenderShape::currentColor()
 {
 	return _currentColor;
 }
-Transform& RenderShape::transform()
+Transform RenderShape::transform()
 {
 	return _transform;
 }
@@ -86,6 +53,14 @@ void RenderShape::count(GLsizei newSize)
 {
 	_count = newSize;
 }
+GLuint RenderShape::firstIndex()
+{
+	return _firstIndex;
+}
+GLint RenderShape::baseVertex()
+{
+	return _baseVertex;
+}
 GLenum RenderShape::mode()
 {
 	return _mode;
@@ -99,3 +74,28 @@ bool& RenderShape::active()
 {
 	return _active;
 }
+
+RenderPass& RenderShape::pass()
+{
+	return _pass;
+}
+
+glm::vec4& RenderShape::bounds()
+{
+	return _bounds;
+}
+
+ShadowCaster& RenderShape::caster()
+{
+	return _caster;
+}
+
+bool& RenderShape::geometryChanged()
+{
+	return _geometryChanged;
+}
+
+ShadingLod& RenderShape::shading()
+{
+	return _shading;
+}
\ No newline at end of file
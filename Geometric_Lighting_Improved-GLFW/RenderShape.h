@@ -4,72 +4,80 @@
 #include <GLM\gtc\matrix_transform.hpp>
 #include <GLM\gtc\quaternion.hpp>
 #include <GLM\gtc\type_ptr.hpp>
+#include "TransformManager.h"
+#include "Pool.h"
 
-struct Transform
+struct Shader
 {
-	glm::vec3 position;
-	glm::vec3 rotationOrigin;
-	glm::quat rotation;
-	glm::vec3 scale;
-	glm::vec3 scaleOrigin;
-
-	glm::vec3 linearVelocity;
-	glm::quat angularVelocity;
-
-	glm::mat4 modelMat;
-
-	Transform* parent;
-
-	Transform()
-	{
-		position = glm::vec3();
-		rotationOrigin = glm::vec3();
-		rotation = glm::quat();
-		scale = glm::vec3(1.0f, 1.0f, 1.0f);
-		scaleOrigin = glm::vec3();
-
-		linearVelocity = glm::vec3();
-		angularVelocity = glm::quat();
+	GLint shaderPointer;
+	// -1 for shaders that don't light, which have no use for the camera position
+	GLint uCamPos;
+	GLint uDrawOffset;
+};
 
-		modelMat = glm::mat4();
+// Shapes are drawn pass by pass in this order, each pass is timed separately on the GPU
+enum RenderPass
+{
+	PASS_OPAQUE,
+	PASS_GIZMO,
+	NUM_RENDER_PASSES
+};
 
-		parent = (Transform*)nullptr;
-	}
+// How a shape shadows lights. Shadows of static casters are cached until one of them changes, dynamic casters are redrawn
+// every frame over the cached ones for the lights they reach
+enum ShadowCaster
+{
+	CASTER_NONE,
+	CASTER_STATIC,
+	CASTER_DYNAMIC
 };
 
-struct Shader
+// Where an opaque shape is lit. Shapes too small on screen for per pixel lighting to show are lit at their vertices instead,
+// with the result interpolated across their triangles
+enum ShadingLod
 {
-	GLint shaderPointer;
-	GLint uModelMat;
-	GLint uViewMat;
-	GLint uProjMat;
-	GLint uColor;
-	GLint uCamPos;
+	SHADING_PIXEL,
+	SHADING_VERTEX
 };
 
+class RenderShape;
+typedef Handle<RenderShape> ShapeHandle;
+
 class RenderShape
 {
 public:
-	RenderShape(GLint vao = 0, GLsizei count = 0, GLenum mode = 0, Shader shader = Shader(), glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+	RenderShape(GLint vao = 0, GLsizei count = 0, GLenum mode = 0, Shader shader = Shader(), glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), GLuint firstIndex = 0, GLint baseVertex = 0);
 	~RenderShape();
 
 	void Update(float dt);
-	void Draw();
 
 	const glm::vec4& color();
 	glm::vec4& currentColor();
-	Transform& transform();
+	Transform transform();
 	GLint vao();
 	GLsizei count();
 	void count(GLsizei newSize);
+	GLuint firstIndex();
+	GLint baseVertex();
 	GLenum mode();
 	Shader shader();
 	bool& active();
+	RenderPass& pass();
+	// Sphere enclosing the shape in its own space, center in xyz and radius in w. A negative radius means the shape
+	// has no known bounds and is lit by every light its clusters hold
+	glm::vec4& bounds();
+	ShadowCaster& caster();
+	// Set by whatever rewrites the shape's vertices, cleared once a frame packet has been built with them
+	bool& geometryChanged();
+	// Chosen by RenderManager::BuildFrame from the shape's size on screen, see RenderManager::SetShadingLod
+	ShadingLod& shading();
 
 private:
 
 	GLint _vao;
 	GLsizei _count;
+	GLuint _firstIndex;
+	GLint _baseVertex;
 	GLenum _mode;
 	Shader _shader;
 
@@ -78,4 +86,9 @@ protected:
 	glm::vec4 _currentColor;
 	Transform _transform;
 	bool _active;
+	RenderPass _pass;
+	glm::vec4 _bounds;
+	ShadowCaster _caster;
+	bool _geometryChanged;
+	ShadingLod _shading;
 };
@@ -0,0 +1,236 @@
+#include "ShadowManager.h"
+#include "RenderManager.h"
+#include "FramePacket.h"
+#include "Init_Shader.h"
+#include "GpuProfiler.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <GLM\gtc\type_ptr.hpp>
+#include <iostream>
+
+GLuint ShadowManager::_target = 0;
+int ShadowManager::_width = 0;
+int ShadowManager::_height = 0;
+
+GLuint ShadowManager::_framebuffer = 0;
+GLuint ShadowManager::_staticCubes = 0;
+GLuint ShadowManager::_shadowCubes = 0;
+
+Shader ShadowManager::_shader;
+GLint ShadowManager::_uViewProjMat;
+GLint ShadowManager::_uLight;
+
+glm::vec4 ShadowManager::_builtLights[LightingManager::MAX_SHADOWED_LIGHTS];
+unsigned int ShadowManager::_builtCasterVersion = 0;
+unsigned int ShadowManager::_versions[LightingManager::MAX_SHADOWED_LIGHTS];
+
+unsigned int ShadowManager::_drawnVersions[LightingManager::MAX_SHADOWED_LIGHTS];
+bool ShadowManager::_drewDynamic[LightingManager::MAX_SHADOWED_LIGHTS];
+
+// Closest a caster can be to a light and still cast a shadow
+static const float SHADOW_NEAR = 0.05f;
+
+// Where each face of a cube map looks and which way is up in it, in the order of the cube map's layers
+static const glm::vec3 FACE_DIRS[6] = {
+	glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+	glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+	glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+static const glm::vec3 FACE_UPS[6] = {
+	glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+	glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+	glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+void ShadowManager::Init()
+{
+	char* shaders[] = { "shadow_vert.glsl", "shadow_frag.glsl" };
+	GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_shader.shaderPointer = initShaders(shaders, types, 2);
+	_shader.uCamPos = -1;
+	_shader.uDrawOffset = glGetUniformLocation(_shader.shaderPointer, "drawOffset");
+	_uViewProjMat = glGetUniformLocation(_shader.shaderPointer, "viewProjMat");
+	_uLight = glGetUniformLocation(_shader.shaderPointer, "light");
+
+	_staticCubes = CreateCubes("static shadow cubes");
+	_shadowCubes = CreateCubes("shadow cubes");
+
+	// Only depth is written, the layer being drawn is attached face by face
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _staticCubes, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Shadow framebuffer is incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, _target);
+
+	for (unsigned int i = 0; i < LightingManager::MAX_SHADOWED_LIGHTS; ++i)
+	{
+		_builtLights[i] = glm::vec4(0.0f);
+		_versions[i] = 0;
+		_drawnVersions[i] = FramePacket::NO_VERSION;
+		_drewDynamic[i] = false;
+	}
+}
+
+void ShadowManager::SetTarget(GLuint framebuffer, int width, int height)
+{
+	_target = framebuffer;
+	_width = width;
+	_height = height;
+}
+
+GLuint ShadowManager::CreateCubes(const char* owner)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_SIZE, SHADOW_SIZE, 6 * LightingManager::MAX_SHADOWED_LIGHTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// Linear filtering of a comparison gives four taps of percentage closer filtering for free
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+	MemoryTracker::TrackGL(GL_TEXTURE, texture, 4 * SHADOW_SIZE * SHADOW_SIZE * 6 * LightingManager::MAX_SHADOWED_LIGHTS, owner);
+	return texture;
+}
+
+void ShadowManager::BuildFrame(FramePacket& packet)
+{
+	PROFILE_ZONE("ShadowManager::BuildFrame");
+
+	bool castersChanged = packet.staticCasterVersion != _builtCasterVersion;
+	_builtCasterVersion = packet.staticCasterVersion;
+
+	// Shadowed lights are given layers in the order they were packed, so cubes are listed by layer
+	packet.shadowCubes.clear();
+	unsigned int numLights = packet.lights.size();
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		const GpuLight& light = packet.lights[i];
+		if (light.shadowLayer < 0)
+			continue;
+
+		unsigned int layer = light.shadowLayer;
+		if (castersChanged || light.position_radius != _builtLights[layer])
+		{
+			_builtLights[layer] = light.position_radius;
+			++_versions[layer];
+		}
+
+		ShadowCube cube;
+		cube.position_radius = light.position_radius;
+		cube.staticVersion = _versions[layer];
+		cube.dynamicCasters = DynamicCastersReach(packet, light.position_radius);
+		packet.shadowCubes.push_back(cube);
+	}
+}
+
+bool ShadowManager::DynamicCastersReach(const FramePacket& packet, const glm::vec4& light)
+{
+	unsigned int numBatches = packet.batches.size();
+	for (unsigned int i = 0; i < numBatches; ++i)
+	{
+		const DrawBatch& batch = packet.batches[i];
+		if (batch.caster != CASTER_DYNAMIC)
+			continue;
+
+		for (unsigned int j = batch.first; j < batch.first + batch.count; ++j)
+		{
+			// Shapes without bounds are assumed to reach every light
+			const glm::vec4& bounds = packet.drawBounds[j];
+			float reach = light.w + bounds.w;
+			glm::vec3 offset = glm::vec3(light.x - bounds.x, light.y - bounds.y, light.z - bounds.z);
+			if (bounds.w < 0.0f || glm::dot(offset, offset) < reach * reach)
+				return true;
+		}
+	}
+	return false;
+}
+
+void ShadowManager::Render(const FramePacket& packet)
+{
+	PROFILE_ZONE("ShadowManager::Render");
+
+	GpuProfiler::BeginPass("shadows");
+
+	bool drewAny = false;
+	unsigned int numCubes = packet.shadowCubes.size();
+	for (unsigned int i = 0; i < numCubes; ++i)
+	{
+		const ShadowCube& cube = packet.shadowCubes[i];
+
+		bool staticChanged = cube.staticVersion != _drawnVersions[i];
+		if (staticChanged)
+		{
+			DrawCube(packet, _staticCubes, i, CASTER_STATIC, true);
+			_drawnVersions[i] = cube.staticVersion;
+			drewAny = true;
+		}
+
+		// The cube lighting reads is left alone unless the static one changed or dynamic casters are, or just were, in it
+		if (staticChanged || cube.dynamicCasters || _drewDynamic[i])
+		{
+			glCopyImageSubData(_staticCubes, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6 * i,
+				_shadowCubes, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6 * i, SHADOW_SIZE, SHADOW_SIZE, 6);
+			if (cube.dynamicCasters)
+			{
+				DrawCube(packet, _shadowCubes, i, CASTER_DYNAMIC, false);
+				drewAny = true;
+			}
+			_drewDynamic[i] = cube.dynamicCasters;
+		}
+	}
+
+	if (drewAny)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, _target);
+		glViewport(0, 0, _width, _height);
+	}
+
+	glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, _shadowCubes);
+	glActiveTexture(GL_TEXTURE0);
+
+	GpuProfiler::EndPass();
+}
+
+void ShadowManager::DrawCube(const FramePacket& packet, GLuint texture, unsigned int layer, ShadowCaster caster, bool clear)
+{
+	const glm::vec4& light = packet.shadowCubes[layer].position_radius;
+	glm::vec3 position = glm::vec3(light.x, light.y, light.z);
+	glm::mat4 projMat = glm::perspective(90.0f, 1.0f, SHADOW_NEAR, light.w);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+	glUseProgram(_shader.shaderPointer);
+	glUniform4fv(_uLight, 1, glm::value_ptr(light));
+	RenderManager::RecordStateChanges(1, 1);
+
+	for (unsigned int face = 0; face < 6; ++face)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 6 * layer + face);
+		if (clear)
+			glClear(GL_DEPTH_BUFFER_BIT);
+
+		glm::mat4 viewProjMat = projMat * glm::lookAt(position, position + FACE_DIRS[face], FACE_UPS[face]);
+		glUniformMatrix4fv(_uViewProjMat, 1, GL_FALSE, glm::value_ptr(viewProjMat));
+		RenderManager::RecordStateChanges(0, 1);
+		RenderManager::DrawCasters(packet, caster, _shader);
+	}
+}
+
+void ShadowManager::DumpData()
+{
+	glDeleteProgram(_shader.shaderPointer);
+	_shader.shaderPointer = 0;
+
+	glDeleteFramebuffers(1, &_framebuffer);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _staticCubes);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _shadowCubes);
+	glDeleteTextures(1, &_staticCubes);
+	glDeleteTextures(1, &_shadowCubes);
+	_framebuffer = _staticCubes = _shadowCubes = 0;
+}
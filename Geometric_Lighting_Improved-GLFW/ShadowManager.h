@@ -0,0 +1,68 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLM\glm.hpp>
+#include "RenderShape.h"
+#include "LightingManager.h"
+
+struct FramePacket;
+
+// What the render thread needs to bring one light's shadow cube up to date
+struct ShadowCube
+{
+	glm::vec4 position_radius;
+	// Bumped whenever the light or any static caster changed, the static cube is redrawn when it differs from the one drawn
+	unsigned int staticVersion;
+	// Dynamic casters reach the light, so their shadows are drawn over a copy of the static cube this frame
+	bool dynamicCasters;
+};
+
+// Omnidirectional shadows for up to LightingManager::MAX_SHADOWED_LIGHTS lights. Every light gets a cube of distances from it to
+// the nearest caster, one layer of a cube map array that lighting.glsl compares against. Static casters are drawn into a cache of
+// cubes that is only redrawn when the light or a static caster changes, and each frame the cubes of lights that dynamic casters
+// reach are copied out of the cache and have the dynamic casters drawn over them. With nothing moving no cube is touched.
+class ShadowManager
+{
+public:
+	static void Init();
+	// Framebuffer and viewport to restore once the cubes are drawn
+	static void SetTarget(GLuint framebuffer, int width, int height);
+	// Simulation thread, lists the packet's shadowed lights with the versions their cubes must match.
+	// RenderManager::BuildFrame and LightingManager::BuildFrame must run first
+	static void BuildFrame(FramePacket& packet);
+	// Render thread, redraws the cubes that are out of date and binds them for lighting.
+	// RenderManager::Upload must have run for the packet first
+	static void Render(const FramePacket& packet);
+	static void DumpData();
+
+	// Texture unit the cubes are read from, must match the binding in lighting.glsl
+	static const GLuint SHADOW_UNIT = 3;
+	// Size of each cube face in texels
+	static const GLsizei SHADOW_SIZE = 256;
+private:
+	// Draws one kind of caster into the six faces of a light's cube
+	static void DrawCube(const FramePacket& packet, GLuint texture, unsigned int layer, ShadowCaster caster, bool clear);
+	static bool DynamicCastersReach(const FramePacket& packet, const glm::vec4& light);
+	static GLuint CreateCubes(const char* owner);
+
+	static GLuint _target;
+	static int _width;
+	static int _height;
+
+	static GLuint _framebuffer;
+	// Cubes holding only the static casters, and the cubes lighting reads with the dynamic casters added
+	static GLuint _staticCubes;
+	static GLuint _shadowCubes;
+
+	static Shader _shader;
+	static GLint _uViewProjMat;
+	static GLint _uLight;
+
+	// Simulation thread, the lights the static cubes were last versioned against
+	static glm::vec4 _builtLights[LightingManager::MAX_SHADOWED_LIGHTS];
+	static unsigned int _builtCasterVersion;
+	static unsigned int _versions[LightingManager::MAX_SHADOWED_LIGHTS];
+
+	// Render thread, the version each static cube was drawn at and whether dynamic casters were last drawn over it
+	static unsigned int _drawnVersions[LightingManager::MAX_SHADOWED_LIGHTS];
+	static bool _drewDynamic[LightingManager::MAX_SHADOWED_LIGHTS];
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+
+// Lock-free queue for exactly one producer thread and one consumer thread.
+// Push and Pop never block, they return false when the queue is full or empty.
+template <typename T, unsigned int CAPACITY>
+class SpscQueue
+{
+public:
+	SpscQueue() : _head(0), _tail(0) {}
+
+	bool Push(const T& value)
+	{
+		unsigned int tail = _tail.load(std::memory_order_relaxed);
+		unsigned int next = (tail + 1) % (CAPACITY + 1);
+		if (next == _head.load(std::memory_order_acquire))
+			return false;
+
+		_items[tail] = value;
+		_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& value)
+	{
+		unsigned int head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+			return false;
+
+		value = _items[head];
+		_head.store((head + 1) % (CAPACITY + 1), std::memory_order_release);
+		return true;
+	}
+private:
+	// One slot is always left empty to tell a full queue from an empty one
+	T _items[CAPACITY + 1];
+	std::atomic<unsigned int> _head;
+	std::atomic<unsigned int> _tail;
+};
@@ -0,0 +1,556 @@
+#include "TransformManager.h"
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+static const unsigned int INVALID_TRANSFORM = 0xFFFFFFFF;
+
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_posX, TransformManager::_posY, TransformManager::_posZ;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_rotX, TransformManager::_rotY, TransformManager::_rotZ, TransformManager::_rotW;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_scaleX, TransformManager::_scaleY, TransformManager::_scaleZ;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_rotOriginX, TransformManager::_rotOriginY, TransformManager::_rotOriginZ;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_scaleOriginX, TransformManager::_scaleOriginY, TransformManager::_scaleOriginZ;
+
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_prevPosX, TransformManager::_prevPosY, TransformManager::_prevPosZ;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_prevRotX, TransformManager::_prevRotY, TransformManager::_prevRotZ, TransformManager::_prevRotW;
+TrackedVector<float, MEM_TRANSFORMS> TransformManager::_prevScaleX, TransformManager::_prevScaleY, TransformManager::_prevScaleZ;
+
+TrackedVector<glm::vec3, MEM_TRANSFORMS> TransformManager::_linearVelocity;
+TrackedVector<glm::quat, MEM_TRANSFORMS> TransformManager::_angularVelocity;
+
+TrackedVector<unsigned int, MEM_TRANSFORMS> TransformManager::_slot;
+TrackedVector<unsigned int, MEM_TRANSFORMS> TransformManager::_handle;
+bool TransformManager::_needsSort = false;
+TrackedVector<unsigned int, MEM_TRANSFORMS> TransformManager::_freeHandles;
+
+TrackedVector<unsigned char, MEM_TRANSFORMS> TransformManager::_moving;
+TrackedVector<unsigned char, MEM_TRANSFORMS> TransformManager::_localDirty;
+TrackedVector<unsigned char, MEM_TRANSFORMS> TransformManager::_worldDirty;
+
+TrackedVector<int, MEM_TRANSFORMS> TransformManager::_parent;
+TrackedVector<glm::mat4, MEM_TRANSFORMS> TransformManager::_localMat;
+TrackedVector<glm::mat4, MEM_TRANSFORMS> TransformManager::_modelMat;
+TrackedVector<glm::mat4, MEM_TRANSFORMS> TransformManager::_renderMat;
+
+template <typename V>
+static void Reorder(V& values, const std::vector<unsigned int>& order)
+{
+	V sorted;
+	sorted.reserve(values.size());
+	unsigned int count = order.size();
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		sorted.push_back(values[order[i]]);
+	}
+	values.swap(sorted);
+}
+
+// Closed form of translate * (scale about scaleOrigin) * (rotate about rotationOrigin), see ComputeLocalMatrices
+static void LocalMatrix(glm::mat4& m, glm::vec3 position, glm::quat rotation, glm::vec3 scale, glm::vec3 rotationOrigin, glm::vec3 scaleOrigin)
+{
+	float qx = rotation.x, qy = rotation.y, qz = rotation.z, qw = rotation.w;
+	float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+	float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+	float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+	float r00 = 1.0f - 2.0f * (yy + zz), r01 = 2.0f * (xy + wz), r02 = 2.0f * (xz - wy);
+	float r10 = 2.0f * (xy - wz), r11 = 1.0f - 2.0f * (xx + zz), r12 = 2.0f * (yz + wx);
+	float r20 = 2.0f * (xz + wy), r21 = 2.0f * (yz - wx), r22 = 1.0f - 2.0f * (xx + yy);
+
+	float sx = scale.x, sy = scale.y, sz = scale.z;
+	float rox = rotationOrigin.x, roy = rotationOrigin.y, roz = rotationOrigin.z;
+	float sox = scaleOrigin.x, soy = scaleOrigin.y, soz = scaleOrigin.z;
+
+	float dx = rox - (r00 * rox + r10 * roy + r20 * roz) - sox;
+	float dy = roy - (r01 * rox + r11 * roy + r21 * roz) - soy;
+	float dz = roz - (r02 * rox + r12 * roy + r22 * roz) - soz;
+
+	m[0] = glm::vec4(sx * r00, sy * r01, sz * r02, 0.0f);
+	m[1] = glm::vec4(sx * r10, sy * r11, sz * r12, 0.0f);
+	m[2] = glm::vec4(sx * r20, sy * r21, sz * r22, 0.0f);
+	m[3] = glm::vec4(position.x + sox + sx * dx, position.y + soy + sy * dy, position.z + soz + sz * dz, 1.0f);
+}
+
+Transform TransformManager::Create()
+{
+	// A freed slot already holds the values of a new transform and belongs to no hierarchy, so reusing it keeps the order too
+	Transform transform;
+	if (!_freeHandles.empty())
+	{
+		transform._index = _freeHandles.back();
+		_freeHandles.pop_back();
+
+		unsigned int i = _slot[transform._index];
+		_localDirty[i] = 1;
+		_worldDirty[i] = 1;
+		return transform;
+	}
+
+	// New transforms have no parent, so appending them keeps the arrays in topological order
+	transform._index = _slot.size();
+	_slot.push_back(_parent.size());
+	_handle.push_back(transform._index);
+
+	_posX.push_back(0.0f); _posY.push_back(0.0f); _posZ.push_back(0.0f);
+	_rotX.push_back(0.0f); _rotY.push_back(0.0f); _rotZ.push_back(0.0f); _rotW.push_back(1.0f);
+	_scaleX.push_back(1.0f); _scaleY.push_back(1.0f); _scaleZ.push_back(1.0f);
+	_rotOriginX.push_back(0.0f); _rotOriginY.push_back(0.0f); _rotOriginZ.push_back(0.0f);
+	_scaleOriginX.push_back(0.0f); _scaleOriginY.push_back(0.0f); _scaleOriginZ.push_back(0.0f);
+
+	_prevPosX.push_back(0.0f); _prevPosY.push_back(0.0f); _prevPosZ.push_back(0.0f);
+	_prevRotX.push_back(0.0f); _prevRotY.push_back(0.0f); _prevRotZ.push_back(0.0f); _prevRotW.push_back(1.0f);
+	_prevScaleX.push_back(1.0f); _prevScaleY.push_back(1.0f); _prevScaleZ.push_back(1.0f);
+
+	_linearVelocity.push_back(glm::vec3());
+	_angularVelocity.push_back(glm::quat());
+
+	_moving.push_back(0);
+	_localDirty.push_back(1);
+	_worldDirty.push_back(1);
+
+	_parent.push_back(-1);
+	_localMat.push_back(glm::mat4());
+	_modelMat.push_back(glm::mat4());
+	_renderMat.push_back(glm::mat4());
+
+	return transform;
+}
+
+void TransformManager::Destroy(Transform transform)
+{
+	if (!transform.valid())
+		return;
+
+	unsigned int slot = _slot[transform._index];
+	unsigned int count = _parent.size();
+	for (unsigned int i = slot + 1; i < count; ++i)
+	{
+		if (_parent[i] == (int)slot)
+		{
+			_parent[i] = -1;
+			_localDirty[i] = 1;
+		}
+	}
+
+	// Back to the values Create gives, and neither moving nor dirty, so updates pass over the slot until it is reused
+	_posX[slot] = _posY[slot] = _posZ[slot] = 0.0f;
+	_rotX[slot] = _rotY[slot] = _rotZ[slot] = 0.0f; _rotW[slot] = 1.0f;
+	_scaleX[slot] = _scaleY[slot] = _scaleZ[slot] = 1.0f;
+	_rotOriginX[slot] = _rotOriginY[slot] = _rotOriginZ[slot] = 0.0f;
+	_scaleOriginX[slot] = _scaleOriginY[slot] = _scaleOriginZ[slot] = 0.0f;
+
+	_prevPosX[slot] = _prevPosY[slot] = _prevPosZ[slot] = 0.0f;
+	_prevRotX[slot] = _prevRotY[slot] = _prevRotZ[slot] = 0.0f; _prevRotW[slot] = 1.0f;
+	_prevScaleX[slot] = _prevScaleY[slot] = _prevScaleZ[slot] = 1.0f;
+
+	_linearVelocity[slot] = glm::vec3();
+	_angularVelocity[slot] = glm::quat();
+
+	_moving[slot] = 0;
+	_localDirty[slot] = 0;
+	_worldDirty[slot] = 0;
+
+	_parent[slot] = -1;
+	_localMat[slot] = glm::mat4();
+	_modelMat[slot] = glm::mat4();
+	_renderMat[slot] = glm::mat4();
+
+	_freeHandles.push_back(transform._index);
+}
+
+void TransformManager::BeginStep()
+{
+	// Assignment reuses the existing storage, so this is a straight copy
+	_prevPosX = _posX; _prevPosY = _posY; _prevPosZ = _posZ;
+	_prevRotX = _rotX; _prevRotY = _rotY; _prevRotZ = _rotZ; _prevRotW = _rotW;
+	_prevScaleX = _scaleX; _prevScaleY = _scaleY; _prevScaleZ = _scaleZ;
+}
+
+void TransformManager::Update(float dt)
+{
+	PROFILE_ZONE("TransformManager::Update");
+
+	if (_needsSort)
+		SortHierarchy();
+
+	unsigned int count = _parent.size();
+	WorkerPool::ParallelFor(count, MIN_PARALLEL_BATCH, [dt](unsigned int begin, unsigned int end)
+	{
+		Integrate(begin, end, dt);
+		ComputeLocalMatrices(begin, end);
+	});
+
+	// Parents come before their children, so by the time a child is reached its parent's model matrix
+	// and dirty flag are final for this frame. Untouched subtrees keep last frame's matrices.
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		int parent = _parent[i];
+		bool dirty = _localDirty[i] || (parent >= 0 && _worldDirty[parent]);
+		_worldDirty[i] = dirty;
+		_localDirty[i] = 0;
+
+		if (dirty)
+			_modelMat[i] = parent < 0 ? _localMat[i] : _modelMat[parent] * _localMat[i];
+	}
+}
+
+void TransformManager::Interpolate(float alpha)
+{
+	PROFILE_ZONE("TransformManager::Interpolate");
+
+	// Transforms that did not change in the last step have nothing to blend, the rest are rebuilt from blended
+	// position, rotation and scale and concatenated with their parent's render matrix
+	unsigned int count = _parent.size();
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		if (!_worldDirty[i])
+		{
+			_renderMat[i] = _modelMat[i];
+			continue;
+		}
+
+		glm::vec3 position = glm::mix(glm::vec3(_prevPosX[i], _prevPosY[i], _prevPosZ[i]), glm::vec3(_posX[i], _posY[i], _posZ[i]), alpha);
+		glm::vec3 scale = glm::mix(glm::vec3(_prevScaleX[i], _prevScaleY[i], _prevScaleZ[i]), glm::vec3(_scaleX[i], _scaleY[i], _scaleZ[i]), alpha);
+		glm::quat rotation = glm::slerp(glm::quat(_prevRotW[i], _prevRotX[i], _prevRotY[i], _prevRotZ[i]), glm::quat(_rotW[i], _rotX[i], _rotY[i], _rotZ[i]), alpha);
+
+		glm::mat4 local;
+		LocalMatrix(local, position, rotation, scale, glm::vec3(_rotOriginX[i], _rotOriginY[i], _rotOriginZ[i]), glm::vec3(_scaleOriginX[i], _scaleOriginY[i], _scaleOriginZ[i]));
+
+		int parent = _parent[i];
+		_renderMat[i] = parent < 0 ? local : _renderMat[parent] * local;
+	}
+}
+
+void TransformManager::DumpData()
+{
+	ReleaseVector(_posX); ReleaseVector(_posY); ReleaseVector(_posZ);
+	ReleaseVector(_rotX); ReleaseVector(_rotY); ReleaseVector(_rotZ); ReleaseVector(_rotW);
+	ReleaseVector(_scaleX); ReleaseVector(_scaleY); ReleaseVector(_scaleZ);
+	ReleaseVector(_rotOriginX); ReleaseVector(_rotOriginY); ReleaseVector(_rotOriginZ);
+	ReleaseVector(_scaleOriginX); ReleaseVector(_scaleOriginY); ReleaseVector(_scaleOriginZ);
+
+	ReleaseVector(_prevPosX); ReleaseVector(_prevPosY); ReleaseVector(_prevPosZ);
+	ReleaseVector(_prevRotX); ReleaseVector(_prevRotY); ReleaseVector(_prevRotZ); ReleaseVector(_prevRotW);
+	ReleaseVector(_prevScaleX); ReleaseVector(_prevScaleY); ReleaseVector(_prevScaleZ);
+
+	ReleaseVector(_linearVelocity);
+	ReleaseVector(_angularVelocity);
+
+	ReleaseVector(_slot);
+	ReleaseVector(_handle);
+	ReleaseVector(_freeHandles);
+	_needsSort = false;
+
+	ReleaseVector(_moving);
+	ReleaseVector(_localDirty);
+	ReleaseVector(_worldDirty);
+
+	ReleaseVector(_parent);
+	ReleaseVector(_localMat);
+	ReleaseVector(_modelMat);
+	ReleaseVector(_renderMat);
+}
+
+void TransformManager::UpdateMoving(unsigned int slot)
+{
+	glm::vec3 v = _linearVelocity[slot];
+	glm::quat w = _angularVelocity[slot];
+	_moving[slot] = v.x != 0.0f || v.y != 0.0f || v.z != 0.0f || w.x != 0.0f || w.y != 0.0f || w.z != 0.0f || w.w != 1.0f;
+}
+
+void TransformManager::SortHierarchy()
+{
+	// Sorting by depth in the hierarchy places every parent ahead of its children,
+	// the sort is stable so siblings keep their relative order
+	unsigned int count = _parent.size();
+	std::vector<unsigned int> depth(count, 0);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		for (int parent = _parent[i]; parent >= 0; parent = _parent[parent])
+			++depth[i];
+	}
+
+	std::vector<unsigned int> order(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&depth](unsigned int a, unsigned int b) { return depth[a] < depth[b]; });
+
+	std::vector<int> newSlot(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		newSlot[order[i]] = i;
+	}
+
+	Reorder(_posX, order); Reorder(_posY, order); Reorder(_posZ, order);
+	Reorder(_rotX, order); Reorder(_rotY, order); Reorder(_rotZ, order); Reorder(_rotW, order);
+	Reorder(_scaleX, order); Reorder(_scaleY, order); Reorder(_scaleZ, order);
+	Reorder(_rotOriginX, order); Reorder(_rotOriginY, order); Reorder(_rotOriginZ, order);
+	Reorder(_scaleOriginX, order); Reorder(_scaleOriginY, order); Reorder(_scaleOriginZ, order);
+
+	Reorder(_prevPosX, order); Reorder(_prevPosY, order); Reorder(_prevPosZ, order);
+	Reorder(_prevRotX, order); Reorder(_prevRotY, order); Reorder(_prevRotZ, order); Reorder(_prevRotW, order);
+	Reorder(_prevScaleX, order); Reorder(_prevScaleY, order); Reorder(_prevScaleZ, order);
+
+	Reorder(_linearVelocity, order);
+	Reorder(_angularVelocity, order);
+
+	Reorder(_moving, order);
+	Reorder(_localDirty, order);
+	Reorder(_worldDirty, order);
+
+	Reorder(_parent, order);
+	Reorder(_localMat, order);
+	Reorder(_modelMat, order);
+	Reorder(_renderMat, order);
+
+	Reorder(_handle, order);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		_slot[_handle[i]] = i;
+		if (_parent[i] >= 0)
+			_parent[i] = newSlot[_parent[i]];
+	}
+
+	_needsSort = false;
+}
+
+void TransformManager::Integrate(unsigned int begin, unsigned int end, float dt)
+{
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		if (!_moving[i])
+			continue;
+
+		_posX[i] += _linearVelocity[i].x * dt;
+		_posY[i] += _linearVelocity[i].y * dt;
+		_posZ[i] += _linearVelocity[i].z * dt;
+
+		// Slerping towards rotation * identity leaves the rotation unchanged, so transforms that only translate skip it
+		glm::quat angularVelocity = _angularVelocity[i];
+		if (angularVelocity.x != 0.0f || angularVelocity.y != 0.0f || angularVelocity.z != 0.0f || angularVelocity.w != 1.0f)
+		{
+			glm::quat rotation = glm::quat(_rotW[i], _rotX[i], _rotY[i], _rotZ[i]);
+			rotation = glm::slerp(rotation, rotation * angularVelocity, dt);
+			_rotX[i] = rotation.x;
+			_rotY[i] = rotation.y;
+			_rotZ[i] = rotation.z;
+			_rotW[i] = rotation.w;
+		}
+
+		_localDirty[i] = 1;
+	}
+}
+
+// The model matrix is translate * (scale about scaleOrigin) * (rotate about rotationOrigin). Expanded, that is
+//	linear part:	diag(scale) * R
+//	translation:	position + scaleOrigin + scale * (rotationOrigin - R * rotationOrigin - scaleOrigin)
+// which needs no matrix products or inverses.
+void TransformManager::ComputeLocalMatrices(unsigned int begin, unsigned int end)
+{
+	unsigned int i = begin;
+#ifdef TRANSFORM_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= end; i += 4)
+	{
+		if (!(_localDirty[i] | _localDirty[i + 1] | _localDirty[i + 2] | _localDirty[i + 3]))
+			continue;
+
+		__m128 qx = _mm_loadu_ps(&_rotX[i]);
+		__m128 qy = _mm_loadu_ps(&_rotY[i]);
+		__m128 qz = _mm_loadu_ps(&_rotZ[i]);
+		__m128 qw = _mm_loadu_ps(&_rotW[i]);
+
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		// Rotation matrix, rCR is column C row R
+		__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		__m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		__m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		__m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		__m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		__m128 sx = _mm_loadu_ps(&_scaleX[i]);
+		__m128 sy = _mm_loadu_ps(&_scaleY[i]);
+		__m128 sz = _mm_loadu_ps(&_scaleZ[i]);
+
+		__m128 rox = _mm_loadu_ps(&_rotOriginX[i]);
+		__m128 roy = _mm_loadu_ps(&_rotOriginY[i]);
+		__m128 roz = _mm_loadu_ps(&_rotOriginZ[i]);
+		__m128 sox = _mm_loadu_ps(&_scaleOriginX[i]);
+		__m128 soy = _mm_loadu_ps(&_scaleOriginY[i]);
+		__m128 soz = _mm_loadu_ps(&_scaleOriginZ[i]);
+
+		// rotationOrigin - R * rotationOrigin - scaleOrigin
+		__m128 dx = _mm_sub_ps(_mm_sub_ps(rox, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, rox), _mm_mul_ps(r10, roy)), _mm_mul_ps(r20, roz))), sox);
+		__m128 dy = _mm_sub_ps(_mm_sub_ps(roy, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r01, rox), _mm_mul_ps(r11, roy)), _mm_mul_ps(r21, roz))), soy);
+		__m128 dz = _mm_sub_ps(_mm_sub_ps(roz, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r02, rox), _mm_mul_ps(r12, roy)), _mm_mul_ps(r22, roz))), soz);
+
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&_posX[i]), sox), _mm_mul_ps(sx, dx));
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&_posY[i]), soy), _mm_mul_ps(sy, dy));
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&_posZ[i]), soz), _mm_mul_ps(sz, dz));
+
+		// Each group holds one column for four transforms, transposing turns it into that column of each matrix
+		__m128 c0x = _mm_mul_ps(sx, r00), c0y = _mm_mul_ps(sy, r01), c0z = _mm_mul_ps(sz, r02), c0w = zero;
+		__m128 c1x = _mm_mul_ps(sx, r10), c1y = _mm_mul_ps(sy, r11), c1z = _mm_mul_ps(sz, r12), c1w = zero;
+		__m128 c2x = _mm_mul_ps(sx, r20), c2y = _mm_mul_ps(sy, r21), c2z = _mm_mul_ps(sz, r22), c2w = zero;
+		__m128 c3w = one;
+		_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+		_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+		_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+		_MM_TRANSPOSE4_PS(tx, ty, tz, c3w);
+
+		float* m0 = glm::value_ptr(_localMat[i]);
+		float* m1 = glm::value_ptr(_localMat[i + 1]);
+		float* m2 = glm::value_ptr(_localMat[i + 2]);
+		float* m3 = glm::value_ptr(_localMat[i + 3]);
+		_mm_storeu_ps(m0, c0x); _mm_storeu_ps(m0 + 4, c1x); _mm_storeu_ps(m0 + 8, c2x); _mm_storeu_ps(m0 + 12, tx);
+		_mm_storeu_ps(m1, c0y); _mm_storeu_ps(m1 + 4, c1y); _mm_storeu_ps(m1 + 8, c2y); _mm_storeu_ps(m1 + 12, ty);
+		_mm_storeu_ps(m2, c0z); _mm_storeu_ps(m2 + 4, c1z); _mm_storeu_ps(m2 + 8, c2z); _mm_storeu_ps(m2 + 12, tz);
+		_mm_storeu_ps(m3, c0w); _mm_storeu_ps(m3 + 4, c1w); _mm_storeu_ps(m3 + 8, c2w); _mm_storeu_ps(m3 + 12, c3w);
+	}
+#endif
+	ComputeLocalMatricesScalar(i, end);
+}
+
+void TransformManager::ComputeLocalMatricesScalar(unsigned int begin, unsigned int end)
+{
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		if (!_localDirty[i])
+			continue;
+
+		LocalMatrix(_localMat[i],
+			glm::vec3(_posX[i], _posY[i], _posZ[i]),
+			glm::quat(_rotW[i], _rotX[i], _rotY[i], _rotZ[i]),
+			glm::vec3(_scaleX[i], _scaleY[i], _scaleZ[i]),
+			glm::vec3(_rotOriginX[i], _rotOriginY[i], _rotOriginZ[i]),
+			glm::vec3(_scaleOriginX[i], _scaleOriginY[i], _scaleOriginZ[i]));
+	}
+}
+
+Transform::Transform()
+{
+	_index = INVALID_TRANSFORM;
+}
+
+glm::vec3 Transform::position()
+{
+	unsigned int i = TransformManager::_slot[_index];
+	return glm::vec3(TransformManager::_posX[i], TransformManager::_posY[i], TransformManager::_posZ[i]);
+}
+void Transform::position(glm::vec3 newPosition)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_posX[i] = newPosition.x;
+	TransformManager::_posY[i] = newPosition.y;
+	TransformManager::_posZ[i] = newPosition.z;
+	TransformManager::_localDirty[i] = 1;
+}
+glm::vec3 Transform::rotationOrigin()
+{
+	unsigned int i = TransformManager::_slot[_index];
+	return glm::vec3(TransformManager::_rotOriginX[i], TransformManager::_rotOriginY[i], TransformManager::_rotOriginZ[i]);
+}
+void Transform::rotationOrigin(glm::vec3 newOrigin)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_rotOriginX[i] = newOrigin.x;
+	TransformManager::_rotOriginY[i] = newOrigin.y;
+	TransformManager::_rotOriginZ[i] = newOrigin.z;
+	TransformManager::_localDirty[i] = 1;
+}
+glm::quat Transform::rotation()
+{
+	unsigned int i = TransformManager::_slot[_index];
+	return glm::quat(TransformManager::_rotW[i], TransformManager::_rotX[i], TransformManager::_rotY[i], TransformManager::_rotZ[i]);
+}
+void Transform::rotation(glm::quat newRotation)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_rotX[i] = newRotation.x;
+	TransformManager::_rotY[i] = newRotation.y;
+	TransformManager::_rotZ[i] = newRotation.z;
+	TransformManager::_rotW[i] = newRotation.w;
+	TransformManager::_localDirty[i] = 1;
+}
+glm::vec3 Transform::scale()
+{
+	unsigned int i = TransformManager::_slot[_index];
+	return glm::vec3(TransformManager::_scaleX[i], TransformManager::_scaleY[i], TransformManager::_scaleZ[i]);
+}
+void Transform::scale(glm::vec3 newScale)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_scaleX[i] = newScale.x;
+	TransformManager::_scaleY[i] = newScale.y;
+	TransformManager::_scaleZ[i] = newScale.z;
+	TransformManager::_localDirty[i] = 1;
+}
+glm::vec3 Transform::scaleOrigin()
+{
+	unsigned int i = TransformManager::_slot[_index];
+	return glm::vec3(TransformManager::_scaleOriginX[i], TransformManager::_scaleOriginY[i], TransformManager::_scaleOriginZ[i]);
+}
+void Transform::scaleOrigin(glm::vec3 newOrigin)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_scaleOriginX[i] = newOrigin.x;
+	TransformManager::_scaleOriginY[i] = newOrigin.y;
+	TransformManager::_scaleOriginZ[i] = newOrigin.z;
+	TransformManager::_localDirty[i] = 1;
+}
+
+glm::vec3 Transform::linearVelocity() { return TransformManager::_linearVelocity[TransformManager::_slot[_index]]; }
+void Transform::linearVelocity(glm::vec3 newVelocity)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_linearVelocity[i] = newVelocity;
+	TransformManager::UpdateMoving(i);
+}
+glm::quat Transform::angularVelocity() { return TransformManager::_angularVelocity[TransformManager::_slot[_index]]; }
+void Transform::angularVelocity(glm::quat newVelocity)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	TransformManager::_angularVelocity[i] = newVelocity;
+	TransformManager::UpdateMoving(i);
+}
+
+const glm::mat4& Transform::modelMat() { return TransformManager::_modelMat[TransformManager::_slot[_index]]; }
+const glm::mat4& Transform::renderMat() { return TransformManager::_renderMat[TransformManager::_slot[_index]]; }
+bool Transform::changed() { return TransformManager::_worldDirty[TransformManager::_slot[_index]] != 0; }
+
+Transform Transform::parent()
+{
+	Transform parent;
+	int parentSlot = TransformManager::_parent[TransformManager::_slot[_index]];
+	parent._index = parentSlot < 0 ? INVALID_TRANSFORM : TransformManager::_handle[parentSlot];
+	return parent;
+}
+void Transform::parent(Transform newParent)
+{
+	unsigned int i = TransformManager::_slot[_index];
+	int parentSlot = newParent.valid() ? (int)TransformManager::_slot[newParent._index] : -1;
+	TransformManager::_parent[i] = parentSlot;
+	TransformManager::_localDirty[i] = 1;
+
+	// A parent stored after its child breaks the single pass update, so the arrays are resorted before the next one
+	if (parentSlot > (int)i)
+		TransformManager::_needsSort = true;
+}
+
+bool Transform::valid() { return _index != INVALID_TRANSFORM; }
@@ -0,0 +1,106 @@
+#pragma once
+#include <GLM\gtc\matrix_transform.hpp>
+#include <GLM\gtc\quaternion.hpp>
+#include <GLM\gtc\type_ptr.hpp>
+#include "MemoryTracker.h"
+#include <vector>
+
+// Handle to a transform whose values live in the TransformManager's arrays.
+// Copying a Transform copies the handle, both copies refer to the same transform.
+class Transform
+{
+public:
+	Transform();
+
+	glm::vec3 position();
+	void position(glm::vec3 newPosition);
+	glm::vec3 rotationOrigin();
+	void rotationOrigin(glm::vec3 newOrigin);
+	glm::quat rotation();
+	void rotation(glm::quat newRotation);
+	glm::vec3 scale();
+	void scale(glm::vec3 newScale);
+	glm::vec3 scaleOrigin();
+	void scaleOrigin(glm::vec3 newOrigin);
+
+	glm::vec3 linearVelocity();
+	void linearVelocity(glm::vec3 newVelocity);
+	glm::quat angularVelocity();
+	void angularVelocity(glm::quat newVelocity);
+
+	const glm::mat4& modelMat();
+	// Model matrix blended between the last two simulation steps by TransformManager::Interpolate
+	const glm::mat4& renderMat();
+	// True when the model matrix was recomputed by the last TransformManager::Update
+	bool changed();
+
+	Transform parent();
+	void parent(Transform newParent);
+
+	bool valid();
+private:
+	friend class TransformManager;
+	unsigned int _index;
+};
+
+// Stores every transform in the scene as structure-of-arrays and computes all model matrices in one batch per frame.
+// The arrays are kept in topological order, parents before children, so world matrices resolve in a single forward pass,
+// and only transforms that moved, or whose parent moved, are recomputed.
+class TransformManager
+{
+public:
+	static Transform Create();
+	// Frees the transform's slot for the next Create, its children are left without a parent. Other copies of the handle
+	// must not be used afterwards
+	static void Destroy(Transform transform);
+
+	// Saves the current state as the one rendering interpolates from, called before each fixed simulation step
+	static void BeginStep();
+	static void Update(float dt);
+	// Computes render matrices alpha of the way from the state saved by BeginStep to the current one
+	static void Interpolate(float alpha);
+
+	static void DumpData();
+private:
+	friend class Transform;
+
+	static void UpdateMoving(unsigned int slot);
+	static void SortHierarchy();
+	static void Integrate(unsigned int begin, unsigned int end, float dt);
+	static void ComputeLocalMatrices(unsigned int begin, unsigned int end);
+	static void ComputeLocalMatricesScalar(unsigned int begin, unsigned int end);
+
+	// Batches smaller than this are not worth waking the worker threads for
+	static const unsigned int MIN_PARALLEL_BATCH = 4096;
+
+	// Components are split into separate float arrays so four transforms can be loaded per SSE register
+	static TrackedVector<float, MEM_TRANSFORMS> _posX, _posY, _posZ;
+	static TrackedVector<float, MEM_TRANSFORMS> _rotX, _rotY, _rotZ, _rotW;
+	static TrackedVector<float, MEM_TRANSFORMS> _scaleX, _scaleY, _scaleZ;
+	static TrackedVector<float, MEM_TRANSFORMS> _rotOriginX, _rotOriginY, _rotOriginZ;
+	static TrackedVector<float, MEM_TRANSFORMS> _scaleOriginX, _scaleOriginY, _scaleOriginZ;
+
+	// Position, rotation and scale as of the start of the last step
+	static TrackedVector<float, MEM_TRANSFORMS> _prevPosX, _prevPosY, _prevPosZ;
+	static TrackedVector<float, MEM_TRANSFORMS> _prevRotX, _prevRotY, _prevRotZ, _prevRotW;
+	static TrackedVector<float, MEM_TRANSFORMS> _prevScaleX, _prevScaleY, _prevScaleZ;
+
+	static TrackedVector<glm::vec3, MEM_TRANSFORMS> _linearVelocity;
+	static TrackedVector<glm::quat, MEM_TRANSFORMS> _angularVelocity;
+
+	// Handles index _slot, which gives the transform's current position in the arrays, _handle maps back the other way
+	static TrackedVector<unsigned int, MEM_TRANSFORMS> _slot;
+	static TrackedVector<unsigned int, MEM_TRANSFORMS> _handle;
+	static bool _needsSort;
+	// Handles of destroyed transforms, whose slots are kept at rest until Create hands them out again
+	static TrackedVector<unsigned int, MEM_TRANSFORMS> _freeHandles;
+
+	static TrackedVector<unsigned char, MEM_TRANSFORMS> _moving;
+	static TrackedVector<unsigned char, MEM_TRANSFORMS> _localDirty;
+	static TrackedVector<unsigned char, MEM_TRANSFORMS> _worldDirty;
+
+	static TrackedVector<int, MEM_TRANSFORMS> _parent;
+	static TrackedVector<glm::mat4, MEM_TRANSFORMS> _localMat;
+	static TrackedVector<glm::mat4, MEM_TRANSFORMS> _modelMat;
+	static TrackedVector<glm::mat4, MEM_TRANSFORMS> _renderMat;
+};
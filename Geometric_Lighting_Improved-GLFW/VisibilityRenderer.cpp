@@ -0,0 +1,152 @@
+#include "VisibilityRenderer.h"
+#include "RenderManager.h"
+#include "FramePacket.h"
+#include "Init_Shader.h"
+#include "GpuProfiler.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <GLM\gtc\type_ptr.hpp>
+#include <iostream>
+
+int VisibilityRenderer::_width = 0;
+int VisibilityRenderer::_height = 0;
+GLuint VisibilityRenderer::_target = 0;
+
+GLuint VisibilityRenderer::_framebuffer = 0;
+GLuint VisibilityRenderer::_visibilityTexture = 0;
+GLuint VisibilityRenderer::_depthBuffer = 0;
+
+Shader VisibilityRenderer::_rasterShader;
+
+GLuint VisibilityRenderer::_shadeProgram = 0;
+GLint VisibilityRenderer::_uViewMat;
+GLint VisibilityRenderer::_uInvViewProjMat;
+GLint VisibilityRenderer::_uInvViewport;
+GLint VisibilityRenderer::_uDrawRange;
+GLint VisibilityRenderer::_uCamPos;
+
+void VisibilityRenderer::Init(int width, int height)
+{
+	_width = width;
+	_height = height;
+
+	char* rasterShaders[] = { "visibility_vert.glsl", "visibility_frag.glsl" };
+	GLenum rasterTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_rasterShader.shaderPointer = initShaders(rasterShaders, rasterTypes, 2);
+	_rasterShader.uCamPos = -1;
+	_rasterShader.uDrawOffset = glGetUniformLocation(_rasterShader.shaderPointer, "drawOffset");
+
+	char* shadeShaders[] = { "fullscreen_vert.glsl", "visibility_shade_frag.glsl" };
+	GLenum shadeTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	_shadeProgram = initShaders(shadeShaders, shadeTypes, 2);
+	_uViewMat = glGetUniformLocation(_shadeProgram, "viewMat");
+	_uInvViewProjMat = glGetUniformLocation(_shadeProgram, "invViewProjMat");
+	_uInvViewport = glGetUniformLocation(_shadeProgram, "invViewport");
+	_uDrawRange = glGetUniformLocation(_shadeProgram, "drawRange");
+	_uCamPos = glGetUniformLocation(_shadeProgram, "camPos");
+
+	glGenTextures(1, &_visibilityTexture);
+	glBindTexture(GL_TEXTURE_2D, _visibilityTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, _width, _height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	MemoryTracker::TrackGL(GL_TEXTURE, _visibilityTexture, 8 * _width * _height, "visibility buffer");
+
+	// Never sampled, only blitted into the target, so a renderbuffer matching the target's depth format is enough
+	glGenRenderbuffers(1, &_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _width, _height);
+	MemoryTracker::TrackGL(GL_RENDERBUFFER, _depthBuffer, 4 * _width * _height, "visibility buffer");
+
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _visibilityTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Visibility buffer is incomplete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, _target);
+}
+
+void VisibilityRenderer::SetTarget(GLuint framebuffer)
+{
+	_target = framebuffer;
+}
+
+void VisibilityRenderer::DrawOpaque(const FramePacket& packet)
+{
+	PROFILE_ZONE("VisibilityRenderer::DrawOpaque");
+
+	GpuProfiler::BeginPass("visibility clear");
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	const GLuint empty[] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, empty);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	GpuProfiler::EndPass();
+
+	RenderManager::DrawPass(packet, PASS_OPAQUE, &_rasterShader);
+
+	GpuProfiler::BeginPass("visibility shading");
+
+	// The target takes the scene's depth so forward passes drawn afterwards are hidden by it
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _target);
+	glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, _target);
+
+	glm::mat4 invViewProjMat = glm::inverse(packet.projMat * packet.viewMat);
+
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(_shadeProgram);
+	glUniformMatrix4fv(_uViewMat, 1, GL_FALSE, glm::value_ptr(packet.viewMat));
+	glUniformMatrix4fv(_uInvViewProjMat, 1, GL_FALSE, glm::value_ptr(invViewProjMat));
+	glUniform2f(_uInvViewport, 1.0f / _width, 1.0f / _height);
+	glUniform4fv(_uCamPos, 1, glm::value_ptr(packet.camPos));
+	RenderManager::RecordStateChanges(1, 4);
+
+	glBindTexture(GL_TEXTURE_2D, _visibilityTexture);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, RenderManager::commandBuffer());
+	glBindVertexArray(RenderManager::emptyVao());
+
+	// Each batch's vertices live in one GeometryBuffer, so the screen is shaded once per opaque batch with its buffers bound,
+	// and every pass discards the pixels of draws outside its batch
+	unsigned int numBatches = packet.batches.size();
+	for (unsigned int i = 0; i < numBatches; ++i)
+	{
+		const DrawBatch& batch = packet.batches[i];
+		if (batch.pass != PASS_OPAQUE || batch.mode != GL_TRIANGLES)
+			continue;
+
+		// Opaque shapes are drawn with the phong shader, which needs normals to light them
+		GeometryBuffer* geometry = RenderManager::FindGeometry(batch.vao);
+		if (!geometry || geometry->format() != VERTEX_POSITION_NORMAL)
+			continue;
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_BINDING, geometry->vertexBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ELEMENT_BINDING, geometry->elementBuffer());
+		glUniform2ui(_uDrawRange, batch.first, batch.first + batch.count);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		RenderManager::RecordStateChanges(0, 1);
+		RenderManager::RecordDrawCall(1, 1);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+
+	GpuProfiler::EndPass();
+}
+
+void VisibilityRenderer::DumpData()
+{
+	glDeleteProgram(_rasterShader.shaderPointer);
+	glDeleteProgram(_shadeProgram);
+	_rasterShader.shaderPointer = 0;
+	_shadeProgram = 0;
+
+	glDeleteFramebuffers(1, &_framebuffer);
+	MemoryTracker::UntrackGL(GL_TEXTURE, _visibilityTexture);
+	MemoryTracker::UntrackGL(GL_RENDERBUFFER, _depthBuffer);
+	glDeleteTextures(1, &_visibilityTexture);
+	glDeleteRenderbuffers(1, &_depthBuffer);
+	_framebuffer = _visibilityTexture = _depthBuffer = 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <GLEW\glew.h>
+#include <GLM\glm.hpp>
+#include "RenderShape.h"
+
+struct FramePacket;
+
+// Visibility buffer shading for the opaque pass. Opaque shapes are rasterized writing nothing but which draw and which triangle
+// covers each pixel, then a full screen pass fetches that triangle's vertices straight from its GeometryBuffer, rebuilds the
+// surface under the pixel and lights it with the clustered lights. Every pixel is shaded exactly once however much it was
+// overdrawn, and only 8 bytes per pixel are written while rasterizing.
+class VisibilityRenderer
+{
+public:
+	// The visibility buffer is created at the given size, which must match the target framebuffer
+	static void Init(int width, int height);
+	// Framebuffer the shaded scene is written to, 0 for the window's
+	static void SetTarget(GLuint framebuffer);
+	// Render thread, rasterizes the packet's opaque pass into the visibility buffer and shades it into the target. The target
+	// is left bound holding the scene's depth, so later forward passes are hidden behind it.
+	// LightingManager::Apply and RenderManager::Upload must have run for the packet first
+	static void DrawOpaque(const FramePacket& packet);
+	static void DumpData();
+
+	// Shader storage binding points, must match the bindings in visibility_shade_frag.glsl
+	static const GLuint COMMAND_BINDING = 4;
+	static const GLuint VERTEX_BINDING = 5;
+	static const GLuint ELEMENT_BINDING = 6;
+private:
+	static int _width;
+	static int _height;
+	static GLuint _target;
+
+	static GLuint _framebuffer;
+	// Draw index plus one and primitive of every pixel, 0 where nothing was drawn
+	static GLuint _visibilityTexture;
+	static GLuint _depthBuffer;
+
+	// Writes the opaque shapes' draw and triangle, reads the same vertices and per-draw buffer as the forward shader
+	static Shader _rasterShader;
+
+	static GLuint _shadeProgram;
+	static GLint _uViewMat;
+	static GLint _uInvViewProjMat;
+	static GLint _uInvViewport;
+	static GLint _uDrawRange;
+	static GLint _uCamPos;
+};
@@ -0,0 +1,116 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <algorithm>
+
+std::vector<std::thread> WorkerPool::_workers;
+std::mutex WorkerPool::_mutex;
+std::condition_variable WorkerPool::_wake;
+std::condition_variable WorkerPool::_finished;
+
+std::function<void(unsigned int, unsigned int)> WorkerPool::_job;
+unsigned int WorkerPool::_count = 0;
+unsigned int WorkerPool::_batchSize = 0;
+unsigned int WorkerPool::_numBatches = 0;
+std::atomic<unsigned int> WorkerPool::_nextBatch(0);
+unsigned int WorkerPool::_batchesDone = 0;
+unsigned int WorkerPool::_activeWorkers = 0;
+unsigned int WorkerPool::_generation = 0;
+bool WorkerPool::_quit = false;
+
+void WorkerPool::Init(unsigned int numWorkers)
+{
+	_quit = false;
+	for (unsigned int i = 0; i < numWorkers; ++i)
+	{
+		_workers.push_back(std::thread(WorkerLoop));
+	}
+}
+
+void WorkerPool::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	unsigned int numWorkers = _workers.size();
+	for (unsigned int i = 0; i < numWorkers; ++i)
+	{
+		_workers[i].join();
+	}
+	_workers.clear();
+}
+
+void WorkerPool::ParallelFor(unsigned int count, unsigned int minBatch, const std::function<void(unsigned int, unsigned int)>& job)
+{
+	if (_workers.empty() || count <= minBatch)
+	{
+		job(0, count);
+		return;
+	}
+
+	// One range per thread at most, but never split below minBatch items
+	unsigned int numBatches = std::min((unsigned int)_workers.size() + 1, (count + minBatch - 1) / minBatch);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = job;
+		_count = count;
+		_numBatches = numBatches;
+		_batchSize = (count + numBatches - 1) / numBatches;
+		_batchesDone = 0;
+		_nextBatch = 0;
+		++_generation;
+	}
+	_wake.notify_all();
+
+	RunBatches();
+
+	// Workers that joined this job must also have left it before the job's state can be replaced
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finished.wait(lock, [] { return _batchesDone == _numBatches && _activeWorkers == 0; });
+}
+
+unsigned int WorkerPool::NumWorkers()
+{
+	return _workers.size();
+}
+
+void WorkerPool::WorkerLoop()
+{
+	Profiler::SetThreadName("Worker");
+
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _quit || _generation != seenGeneration; });
+			if (_quit)
+				return;
+			seenGeneration = _generation;
+			++_activeWorkers;
+		}
+		RunBatches();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_activeWorkers == 0)
+			_finished.notify_all();
+	}
+}
+
+void WorkerPool::RunBatches()
+{
+	unsigned int batch;
+	while ((batch = _nextBatch++) < _numBatches)
+	{
+		unsigned int begin = batch * _batchSize;
+		unsigned int end = std::min(_count, begin + _batchSize);
+		if (begin < end)
+			_job(begin, end);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (++_batchesDone == _numBatches)
+			_finished.notify_all();
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads used to split large batches of independent work across cores
+class WorkerPool
+{
+public:
+	static void Init(unsigned int numWorkers);
+	static void Shutdown();
+
+	// Runs job over [0, count) in contiguous ranges, the calling thread takes part and the call returns once every range is done.
+	// Counts of minBatch or less run inline without waking the workers.
+	static void ParallelFor(unsigned int count, unsigned int minBatch, const std::function<void(unsigned int, unsigned int)>& job);
+
+	static unsigned int NumWorkers();
+private:
+	static void WorkerLoop();
+	static void RunBatches();
+
+	static std::vector<std::thread> _workers;
+	static std::mutex _mutex;
+	static std::condition_variable _wake;
+	static std::condition_variable _finished;
+
+	static std::function<void(unsigned int, unsigned int)> _job;
+	static unsigned int _count;
+	static unsigned int _batchSize;
+	static unsigned int _numBatches;
+	static std::atomic<unsigned int> _nextBatch;
+	static unsigned int _batchesDone;
+	static unsigned int _activeWorkers;
+	static unsigned int _generation;
+	static bool _quit;
+};
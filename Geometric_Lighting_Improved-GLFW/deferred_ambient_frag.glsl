@@ -0,0 +1,12 @@
+#version 440
+
+#include "lighting.glsl"
+
+layout(binding = 0) uniform sampler2D albedoTexture;
+
+out vec4 outColor;
+
+void main()
+{
+	outColor = ambient * texelFetch(albedoTexture, ivec2(gl_FragCoord.xy), 0);
+};
@@ -0,0 +1,18 @@
+#version 440
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "draw_data.glsl"
+
+// Matches the forward shader's locations so opaque shapes are drawn from their own vertex arrays
+layout(location = 0) in vec3 position;
+
+uniform int drawOffset;
+
+// Computed exactly as in vShader.glsl, the lit pass only shades fragments whose depth equals the one written here
+invariant gl_Position;
+
+void main()
+{
+	DrawData draw = draws[drawOffset + gl_DrawIDARB];
+	gl_Position = draw.mvpMat * vec4(position.xyz, 1.0);
+}
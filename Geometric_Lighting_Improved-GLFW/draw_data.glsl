@@ -0,0 +1,16 @@
+// Per-draw values written by RenderManager::BuildFrame, matches DrawData in RenderManager.h (std430)
+
+struct DrawData
+{
+	mat4 mvpMat;
+	mat4 modelMat;
+	mat3 normalMat;
+	vec4 color;
+	// Offset into objectLightIndices and number of lights reaching the shape, a count of 0xffffffff for shapes without bounds
+	uvec2 lightRange;
+};
+
+layout(std430, binding = 0) readonly buffer DrawBuffer
+{
+	DrawData draws[];
+};
@@ -1,44 +1,24 @@
 #version 440
 
-const int MAX_LIGHTS = 8;
-
-struct Light
-{
-	vec4 position;
-	vec4 color_difPower;
-};
+#include "lighting.glsl"
 
 in vec4 Color;
 in vec4 Normal;
 in vec4 WorldPos;
-in vec4 CamPos;
-
-uniform Light lights[MAX_LIGHTS];
-uniform vec4 ambient;
+flat in uvec2 ObjectLights;
 
 out vec4 outColor;
 
 void main()
 {
-	vec4 diffuse = vec4(0.0, 0.0, 0.0, 1.0);
-	vec4 specular = vec4(0.0, 0.0, 0.0, 1.0);
-	vec4 lightColor, lightVec, lightDir, highlight, outVec, specInt;
-	float dis, NdotL, lightPower;
-	for(int i = 0; i < MAX_LIGHTS; ++i)
-	{
-		lightColor = vec4(lights[i].color_difPower.xyz, 1.0);
-		lightPower = lights[i].color_difPower.w;
-		lightVec = vec4(lights[i].position.xyz - WorldPos.xyz, 0.0);
-		lightDir = normalize(lightVec);
-		
-		dis = length(lightVec);
-		NdotL = dot(Normal, lightDir);
-		diffuse += clamp(NdotL, 0.0, 1.0) * lightColor * lightPower / (dis * dis);
-		
-		highlight = reflect(-lightDir, Normal);
-		outVec = normalize(CamPos - WorldPos);
-		specular += lightColor * pow(max(dot(highlight, outVec), 0.0), 3.0);
-	}
-	
-	outColor = specular + (diffuse + ambient) * Color;
-};
\ No newline at end of file
+#if defined(PER_VERTEX_LIGHTING)
+	// Already lit in the vertex shader
+	outColor = Color;
+#elif defined(NUM_LIGHTS)
+	// Defined by LightingManager for variants specialized to the number of active lights
+	outColor = ShadeAll(WorldPos, Normal, Color);
+#else
+	// gl_FragCoord.w is 1 / clip w, which for a perspective projection is the view depth
+	outColor = ShadeCulled(WorldPos, Normal, Color, ClusterIndex(gl_FragCoord.xy, 1.0 / gl_FragCoord.w), ObjectLights);
+#endif
+};
@@ -0,0 +1,8 @@
+#version 440
+
+void main()
+{
+	// One triangle covering the whole screen, its corners come from the vertex index alone
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+};
@@ -0,0 +1,15 @@
+#version 440
+
+in vec4 Color;
+in vec4 Normal;
+in vec4 WorldPos;
+
+// Position is rebuilt from the depth buffer when lighting, so only the surface's color and normal are stored
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+
+void main()
+{
+	outAlbedo = Color;
+	outNormal = vec4(Normal.xyz, 0.0);
+};
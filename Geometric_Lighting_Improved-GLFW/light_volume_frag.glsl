@@ -0,0 +1,41 @@
+#version 440
+
+#include "lighting.glsl"
+
+flat in int LightIndex;
+
+layout(binding = 0) uniform sampler2D albedoTexture;
+layout(binding = 1) uniform sampler2D normalTexture;
+layout(binding = 2) uniform sampler2D depthTexture;
+
+uniform mat4 invViewProjMat;
+uniform vec2 invViewport;
+
+out vec4 outColor;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	// World position of the surface under the pixel, unprojected from its depth
+	float depth = texelFetch(depthTexture, pixel, 0).r;
+	// Nothing was drawn here, only reachable by volumes clamped to the far plane
+	if (depth == 1.0)
+		discard;
+	vec4 position = invViewProjMat * vec4(gl_FragCoord.xy * invViewport * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	vec4 WorldPos = vec4(position.xyz / position.w, 1.0);
+
+	Light light = lights[LightIndex];
+	if (distance(light.position_radius.xyz, WorldPos.xyz) >= light.position_radius.w)
+		discard;
+
+	vec4 Color = texelFetch(albedoTexture, pixel, 0);
+	vec4 Normal = vec4(texelFetch(normalTexture, pixel, 0).xyz, 0.0);
+
+	// The ambient term was already written for every pixel
+	vec4 diffuse = vec4(0.0);
+	vec4 specular = vec4(0.0);
+	AddLight(light, WorldPos, Normal, normalize(camPos - WorldPos), diffuse, specular);
+
+	outColor = specular + diffuse * Color;
+};
@@ -0,0 +1,18 @@
+#version 440
+
+#include "lighting.glsl"
+
+layout(location = 0) in vec3 position;
+
+uniform mat4 viewProjMat;
+
+flat out int LightIndex;
+
+void main()
+{
+	// One instance per light, the unit sphere is scaled to the light's radius and lights that are off collapse to a point
+	Light light = lights[gl_InstanceID];
+	float radius = light.color_power.w > 0.0 ? light.position_radius.w : 0.0;
+	LightIndex = gl_InstanceID;
+	gl_Position = viewProjMat * vec4(light.position_radius.xyz + position * radius, 1.0);
+};
@@ -0,0 +1,155 @@
+// Lights, clusters and the phong model shared by every shader that lights surfaces, included after #version
+
+const uvec3 CLUSTER_DIMS = uvec3(16, 9, 24);
+
+struct Light
+{
+	vec4 position_radius;
+	vec4 color_power;
+	// Layer of the light's cube in shadowCubes, -1 for lights without shadows
+	int shadowLayer;
+};
+
+layout(std430, binding = 1) readonly buffer LightBuffer
+{
+	Light lights[];
+};
+
+// Offset into lightIndices and number of lights for every cluster
+layout(std430, binding = 2) readonly buffer ClusterBuffer
+{
+	uvec2 clusters[];
+};
+
+layout(std430, binding = 3) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+// Lights reaching each shape's bounds, ranges are given by DrawData.lightRange
+layout(std430, binding = 7) readonly buffer ObjectLightBuffer
+{
+	uint objectLightIndices[];
+};
+
+// Matches GpuLightingParams in LightingManager.h, shared by every program and only uploaded when it changes
+layout(std140, binding = 0) uniform LightingParams
+{
+	vec4 ambient;
+	// Clusters per pixel on screen, and the scale and bias turning log(view depth) into a depth slice
+	vec2 clusterTileScale;
+	vec2 clusterDepth;
+};
+
+uniform vec4 camPos;
+
+// Distance to the nearest caster over the light's radius in every direction from each shadowed light, see ShadowManager
+layout(binding = 3) uniform samplerCubeArrayShadow shadowCubes;
+
+// Keeps surfaces from shadowing themselves where the stored distance was rounded below their own. Both are in world units, the
+// slope part grows with the tangent of the angle between the surface and the light, up to SHADOW_MAX_SLOPE times as much
+const float SHADOW_BIAS = 0.01;
+const float SHADOW_SLOPE_BIAS = 0.02;
+const float SHADOW_MAX_SLOPE = 4.0;
+
+// 1 where the light reaches the surface, 0 where a caster is in the way, filtered in between. NdotL is the cosine of the
+// angle between the surface and the direction to the light
+float Shadow(Light light, vec4 WorldPos, float NdotL)
+{
+	if (light.shadowLayer < 0)
+		return 1.0;
+
+	float cosine = clamp(NdotL, 0.01, 1.0);
+	float slope = min(sqrt(1.0 - cosine * cosine) / cosine, SHADOW_MAX_SLOPE);
+	vec3 fromLight = WorldPos.xyz - light.position_radius.xyz;
+	float distance = length(fromLight) - SHADOW_BIAS - SHADOW_SLOPE_BIAS * slope;
+	return texture(shadowCubes, vec4(fromLight, float(light.shadowLayer)), distance / light.position_radius.w);
+}
+
+uint ClusterIndex(vec2 fragCoord, float viewDepth)
+{
+	uvec2 tile = min(uvec2(fragCoord * clusterTileScale), CLUSTER_DIMS.xy - 1u);
+	uint slice = min(uint(max(log(viewDepth) * clusterDepth.x + clusterDepth.y, 0.0)), CLUSTER_DIMS.z - 1u);
+	return tile.x + CLUSTER_DIMS.x * (tile.y + CLUSTER_DIMS.y * slice);
+}
+
+// Adds one light's diffuse and specular terms, outVec points from the surface to the camera
+void AddLight(Light light, vec4 WorldPos, vec4 Normal, vec4 outVec, inout vec4 diffuse, inout vec4 specular)
+{
+	vec4 lightColor = vec4(light.color_power.xyz, 1.0);
+	float lightPower = light.color_power.w;
+	vec4 lightVec = vec4(light.position_radius.xyz - WorldPos.xyz, 0.0);
+	vec4 lightDir = normalize(lightVec);
+
+	float dis = length(lightVec);
+
+	// Fades the light smoothly to nothing at its radius, so cutting it off at the cluster bounds leaves no seam
+	float falloff = dis / light.position_radius.w;
+	float window = clamp(1.0 - falloff * falloff * falloff * falloff, 0.0, 1.0);
+	float NdotL = dot(Normal, lightDir);
+	window *= window * Shadow(light, WorldPos, NdotL);
+
+	diffuse += clamp(NdotL, 0.0, 1.0) * lightColor * lightPower / (dis * dis) * window;
+
+	vec4 highlight = reflect(-lightDir, Normal);
+	specular += lightColor * pow(max(dot(highlight, outVec), 0.0), 3.0) * window;
+}
+
+// Ambient light plus every light binned into the given cluster
+vec4 ShadeClustered(vec4 WorldPos, vec4 Normal, vec4 Color, uint clusterIndex)
+{
+	vec4 diffuse = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 specular = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 outVec = normalize(camPos - WorldPos);
+
+	// Only the lights whose radius reaches this cluster are visited
+	uvec2 cluster = clusters[clusterIndex];
+	for(uint i = 0u; i < cluster.y; ++i)
+	{
+		AddLight(lights[lightIndices[cluster.x + i]], WorldPos, Normal, outVec, diffuse, specular);
+	}
+
+	return specular + (diffuse + ambient) * Color;
+}
+
+// Ambient light plus every light reaching the shape's bounds, only for shapes that have bounds
+vec4 ShadeObject(vec4 WorldPos, vec4 Normal, vec4 Color, uvec2 objectLights)
+{
+	vec4 diffuse = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 specular = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 outVec = normalize(camPos - WorldPos);
+
+	for(uint i = 0u; i < objectLights.y; ++i)
+	{
+		AddLight(lights[objectLightIndices[objectLights.x + i]], WorldPos, Normal, outVec, diffuse, specular);
+	}
+
+	return specular + (diffuse + ambient) * Color;
+}
+
+// Ambient light plus either the given cluster's lights or the shape's own, whichever list is shorter. Both hold every light
+// that can reach the fragment, so the result is the same either way
+vec4 ShadeCulled(vec4 WorldPos, vec4 Normal, vec4 Color, uint clusterIndex, uvec2 objectLights)
+{
+	if (clusters[clusterIndex].y <= objectLights.y)
+		return ShadeClustered(WorldPos, Normal, Color, clusterIndex);
+	return ShadeObject(WorldPos, Normal, Color, objectLights);
+}
+
+#ifdef NUM_LIGHTS
+// Ambient light plus every light, for programs compiled for a light count small enough that visiting them all is cheaper than
+// looking up a cluster. The bound is known when compiling, so the loop can be unrolled
+vec4 ShadeAll(vec4 WorldPos, vec4 Normal, vec4 Color)
+{
+	vec4 diffuse = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 specular = vec4(0.0, 0.0, 0.0, 1.0);
+	vec4 outVec = normalize(camPos - WorldPos);
+
+	for(int i = 0; i < NUM_LIGHTS; ++i)
+	{
+		AddLight(lights[i], WorldPos, Normal, outVec, diffuse, specular);
+	}
+
+	return specular + (diffuse + ambient) * Color;
+}
+#endif
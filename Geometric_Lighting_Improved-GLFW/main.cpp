@@ -25,22 +25,48 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *	to be placed in the scene. Furthermore, it adds a phong lighting model to the fragment shader, making our teapot even prettier.
 *	Also, to make things a bit easier to see and understand, this code includes some boxes using self-lit shaders to indicate the positions
 *	of the lights in the scene.
-*	There are 4 static component classes that make up the base functionality of this program.
+*	There are 6 static component classes that make up the base functionality of this program.
 *
 *	1) RenderManager
 *	- This class maintains the display list for the scene being rendered and thus handles the processes of updating and drawing all
-*	of the RenderShapes that have been instantiated in the scene.
+*	of the RenderShapes that have been instantiated in the scene. It counts the draw calls, program and VAO binds, uniform uploads,
+*	triangles, bytes uploaded and patches retessellated each frame, which are available through RenderManager::stats() and logged as
+*	per frame averages every few hundred frames. With forward shading, opaque shapes whose bounds cover fewer than 48 pixels across
+*	on screen are lit per vertex, and only go back to per pixel lighting once a quarter wider again. --shading-lod N changes the
+*	threshold, 0 lights everything per pixel. Running with --depth-prepass draws the opaque shapes into depth first with a position only
+*	program, then lights them with the depth test at GL_EQUAL so hidden fragments of overlapping patches are never shaded.
 *
 *	2) CameraManager
 *	- This class maintains data relating to the view and projection matrices used in the rendering pipeline. It also handles updating
 *	this data based on user input.
 *
 *	3) InputManager
-*	- This class maintains data for the current state of user input for the mouse and keyboard.
+*	- This class maintains data for the current state of user input for the mouse and keyboard. Input is polled from GLFW on the main
+*	thread and handed to the simulation thread as a snapshot.
 *
 *	4) LightingManager
-*	- This class maintains data for an array of eight lights, each posessing a trasform, color and power, handles the updating thereof and 
-*	maintains gpu-side buffers reflecting this data for use in the shaders. 
+*	- This class maintains data for up to 4096 point lights, each posessing a trasform, color, power and radius, handles the updating thereof
+*	and maintains gpu-side buffers reflecting this data for use in the shaders. Lighting is clustered: the view frustum is divided into
+*	16x9 screen tiles by 24 exponentially spaced depth slices, each light is binned into the clusters its radius reaches on the simulation
+*	thread, and the fragment shader only loops over the lights of its own cluster. Lights, clusters and the ambient and cluster parameters
+*	sit in buffers at fixed binding points shared by every lit shader, and are only uploaded in frames where they changed.
+*	Only lights that are on are sent to the GPU. With 8 or fewer of them the opaque shapes are drawn with a variant of the phong shader
+*	compiled for exactly that many lights, which skips the cluster lookup and visits every light in a loop the compiler can unroll.
+*	Running with --lights N adds N small lights that follow keyframed orbits. For scenes with very many lights, --light-error R builds a
+*	tree over the lights, and each cluster and shape shades a group of lights smaller than R times its distance as one virtual light
+*	at the group's center with its summed power, wherever the group's falloff also stays within R of the merged light's. Lighting
+*	stays within that bound of the exact result in exchange for shorter light lists.
+*
+*	5) TransformManager
+*	- This class stores the position, rotation, scale and origins of every transform in the scene as separate arrays and computes all
+*	of the model matrices in one batch each frame, four at a time with SSE and split across the WorkerPool's threads for large scenes.
+*	Objects only hold a Transform handle into these arrays. The arrays are kept sorted so parents come before their children and
+*	dirty flags are pushed down the hierarchy, so only transforms that moved, or whose parents moved, are recomputed.
+*
+*	6) AnimationManager
+*	- Drives the position, rotation, scale and color of transforms and lights from keyframed tracks. The keys of every track are stored
+*	back to back, and each step all tracks are sampled in one batch, split across the WorkerPool for large counts, blending each sample's
+*	four components at once with SSE, before the samples are written to their targets.
 *
 *	B_Spline
 *	- This non-static class is instantiated to maintain an array of Patch objects. Control point data is sent to this class to manipulate
@@ -56,17 +82,99 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *	transform data. This transform data is used to generate the model matrix used along with the view and projection matrices in the
 *	rendering pipeline.
 *
+*	GeometryBuffer
+*	- This class owns a vertex array object with vertex and element buffers that are shared by every shape using the same shader and
+*	vertex format. Shapes are given a range within these buffers, which lets the RenderManager draw them all with a single
+*	glMultiDrawElementsIndirect call, the shaders fetch each shape's model matrix and color through gl_DrawID.
+*
+*	Pool
+*	- A template container that keeps RenderShapes, Patches and Lights packed contiguously and hands out generational Handles to them
+*	in place of raw pointers, so stale references to destroyed objects can be detected.
+*
+*	FramePacket
+*	- Holds everything needed to draw one frame: per-draw data and batches, camera matrices, light values and pending vertex uploads.
+*	The simulation runs on its own thread at a fixed rate, 60 steps a second unless --sim-rate N sets another, and fills packets in,
+*	blending transforms and light positions between the last two steps, while the main thread, which owns the GL context, only submits them.
+*	Two packets are passed back and forth, so the next frame is simulated while the current one is being drawn, and a thread left
+*	without a packet sleeps until the other hands one over.
+*
+*	FramePacer
+*	- Sets the swap interval, optionally caps the frame rate by sleeping then spinning up to each frame's deadline, and records the CPU
+*	time, time spent waiting in the swap and total time of every frame into histograms that are logged as p50/p95/p99.
+*
+*	GpuProfiler
+*	- Wraps each render pass (clear, uploads, lights, shadows, opaque shapes, deferred lighting or visibility shading, light gizmos) in
+*	GL_TIME_ELAPSED queries. Every pass keeps a small ring of query objects that are read back a few frames after being issued, so
+*	timing never stalls the pipeline, and average GPU time per pass is logged periodically.
+*
+*	Profiler
+*	- Scoped CPU timing zones, placed with PROFILE_ZONE, that record into a buffer per thread without locking while a capture is running.
+*	Pressing P starts a capture and pressing it again writes it to trace.json in the Chrome Trace Event format, which can be opened in
+*	chrome://tracing or ui.perfetto.dev. Zones cost a single flag check when not capturing and compile out with ENABLE_PROFILING 0.
+*
+*	MemoryTracker
+*	- Charges CPU heap memory to subsystems through a tagged allocator used by Pool and the large per-system arrays, and records the size
+*	and owner of every GL buffer. Pressing M logs current and peak usage per subsystem and GL bytes per owner, and anything still allocated
+*	once every system has shut down is reported as a leak.
+*
+*	DeferredRenderer
+*	- Running with --deferred shades the opaque shapes with deferred lighting instead. They are drawn once into a G-buffer holding
+*	their color, normal and depth, then every light is drawn as an instanced sphere of its radius whose back faces only shade the pixels
+*	inside it, adding each light's contribution to the screen. Lighting then costs as much as the pixels each light covers, however many
+*	times the surfaces under them were overdrawn. Clustering is turned off in this mode since nothing reads the clusters.
+*
+*	ShadowManager
+*	- The three main lights cast shadows from the teapot. Each shadowed light has a cube of distances to the nearest caster, one layer
+*	of a cube map array the lighting shaders compare against with hardware filtering. Shapes are marked as static or dynamic casters:
+*	static casters are drawn into a cache of cubes that is only redrawn when the light or one of them moves or changes shape, and dynamic
+*	casters are drawn every frame over a copy of the cache for the lights they reach. When nothing moves no cube is redrawn.
+*
+*	VisibilityRenderer
+*	- Running with --visibility shades the opaque shapes from a visibility buffer instead. Rasterizing only writes which draw and which
+*	triangle covers each pixel, 8 bytes per pixel, then one full screen pass per batch reads that triangle's vertices straight from its
+*	GeometryBuffer, finds where the pixel's view ray meets it and lights that point with the clustered lights. Each pixel is shaded once
+*	however many patch triangles overlap it.
+*
+*	Benchmark
+*	- Running with --benchmark [--frames N] [--output file.json] renders into an offscreen framebuffer of a hidden window, using an EGL
+*	context where GLFW supports one so it can run without a display, for a fixed number of frames along a scripted camera orbit with
+*	one simulation step per frame. It then prints frame time percentiles, GPU pass times, draw calls and triangles per frame as JSON.
+*
+*	SpscQueue
+*	- A lock-free single producer, single consumer ring buffer, used to pass frame packets between the simulation and render threads.
+*
+*	WorkerPool
+*	- Contains a set of persistent worker threads and a ParallelFor function used to split large batches of work across cores.
+*
 *	Init_Shader
-*	- Contains static functions for reading, compiling and linking shaders.
+*	- Contains static functions for reading, compiling and linking shaders, expanding #include "file" lines as shaders are read.
 *
 *
 *	SHADERS
 *
 *	vShader.glsl
-*	- Simple through shader, applies transforms to verts and normals before passing them through to the fragment shader.
+*	- Simple through shader, applies transforms to verts and normals before passing them through to the fragment shader. The combined
+*	model-view-projection matrix and the normal matrix are computed once per shape on the CPU and read from the per-draw buffer.
+*	Compiled with PER_VERTEX_LIGHTING defined it lights each vertex with the shape's own lights for shapes too small on screen for
+*	per pixel lighting to show, and fShader.glsl only passes the interpolated color through.
+*
+*	lighting.glsl, draw_data.glsl
+*	- Pulled into other shaders with #include, which Init_Shader expands. lighting.glsl holds the light and cluster buffers, the cluster
+*	lookup and the phong model every lit shader shares, draw_data.glsl the per-draw buffer.
+*
+*	depth_vert.glsl
+*	- Position only vertex shader for the depth prepass, linked without a fragment shader. Its position is computed exactly as in
+*	vShader.glsl and both mark it invariant, so the lit pass finds the same depths.
+*
+*	shadow_vert.glsl, shadow_frag.glsl
+*	- Draw shadow casters into one face of a light's cube, writing their distance from the light over its radius as depth.
 *
 *	fShader.glsl
-*	- Uses a hard-coded point-light to apply the color of the light to the current fragment based on the phong lighting model.
+*	- Looks up the lights binned into the fragment's cluster and applies the color of each to the current fragment based on the phong
+*	lighting model. Every light is faded to nothing at its radius so lights never pop as they cross cluster boundaries. Compiled with
+*	NUM_LIGHTS defined it skips the clusters and visits that many lights instead. Shapes with bounds, like the teapot's patches, also
+*	carry a list of the lights reaching their bounding sphere, built on the CPU each frame, and fragments visit whichever of the
+*	two lists is shorter.
 *	see: http://en.wikipedia.org/wiki/Phong_reflection_model
 *	Under the phong lighting model, the color of a surface is dertermined by ls + ld + la
 *	la is the ambient light of the scene and is a set constant value.
@@ -80,6 +188,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *	Approach an exponent of 0.0 for some seriously trippy highlight action.
 *	So ls = pow(max(reflect(-lightDr, Normal) dot viewingVector, 0.0), shininessExponent) * specularColor
 *
+*	gbuffer_frag.glsl
+*	- Writes the color and normal passed down by vShader.glsl into the G-buffer, the position is rebuilt from depth when lighting.
+*
+*	fullscreen_vert.glsl, deferred_ambient_frag.glsl
+*	- Cover the screen with a single triangle and write the ambient light of the surface under every pixel.
+*
+*	light_volume_vert.glsl, light_volume_frag.glsl
+*	- Scale a sphere to each light's radius, then rebuild the position of the surface under each pixel the sphere covers from the
+*	G-buffer's depth and add that light's phong terms, with the same falloff as fShader.glsl.
+*
+*	visibility_vert.glsl, visibility_frag.glsl
+*	- Write the index of the draw and the triangle covering each pixel into the visibility buffer.
+*
+*	visibility_shade_frag.glsl
+*	- Fetches the triangle under each pixel from the vertex and element buffers, rebuilds its position and normal and lights it.
+*
 *	self_illum_vert.glsl
 *	- Through shader
 *
@@ -92,8 +216,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <GLM\gtc\matrix_transform.hpp>
 #include <GLM\gtc\quaternion.hpp>
 #include <GLM\gtc\random.hpp>
+#include <GLM\gtc\constants.hpp>
 #include <iostream>
 #include <ctime>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
 
 #include "RenderShape.h"
 #include "Init_Shader.h"
@@ -103,19 +237,79 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "Patch.h"
 #include "CameraManager.h"
 #include "LightingManager.h"
+#include "TransformManager.h"
+#include "WorkerPool.h"
+#include "FramePacket.h"
+#include "SpscQueue.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "Benchmark.h"
+#include "DeferredRenderer.h"
+#include "VisibilityRenderer.h"
+#include "ShadowManager.h"
+#include "AnimationManager.h"
 
 GLFWwindow* window;
 
+// Packets travel from the simulation thread to the render thread through filledPackets and come back through freePackets,
+// with two of them one frame can be simulated while the previous one is drawn
+const unsigned int NUM_FRAME_PACKETS = 2;
+FramePacket framePackets[NUM_FRAME_PACKETS];
+SpscQueue<FramePacket*, NUM_FRAME_PACKETS> filledPackets;
+SpscQueue<FramePacket*, NUM_FRAME_PACKETS> freePackets;
+
+// A thread with no packet to work on sleeps until the other pushes one. The queues stay lock-free, the mutex only keeps
+// a push from landing between a failed Pop and the wait after it
+std::mutex packetMutex;
+std::condition_variable packetFilled;
+std::condition_variable packetFreed;
+// The render thread goes back to polling events at least this often while it waits
+const std::chrono::milliseconds MAX_PACKET_WAIT = std::chrono::milliseconds(5);
+
+std::atomic<bool> running;
+
+// The simulation always advances in steps of 1 / simulationRate seconds, rendering blends between the last two steps.
+// When it falls behind by more than MAX_SIMULATION_STEPS steps the extra time is dropped instead of trying to catch up.
+// Set from the command line: --sim-rate N steps N times a second
+float simulationRate = 60.0f;
+const int MAX_SIMULATION_STEPS = 5;
+
+// Swap interval passed to the driver, 1 waits for vsync, and an optional frame rate cap, 0 for none
+int swapInterval = 1;
+float maxFps = 0.0f;
+
+// Set from the command line: --benchmark [--frames N] [--output file.json]
+bool benchmark = false;
+unsigned int benchmarkFrames = 1000;
+const char* benchmarkOutput = nullptr;
+
+// Set from the command line: --lights N adds N small lights orbiting the teapot
+unsigned int extraLights = 0;
+// Set from the command line: --light-error R lets clusters and shapes merge groups of lights smaller than R times their distance
+float lightCutError = 0.0f;
+// Set from the command line: --shading-lod N lights opaque shapes narrower than N pixels on screen per vertex, 0 turns it off
+float shadingLodPixels = 48.0f;
+// Set from the command line: --depth-prepass lays down the opaque shapes' depth before forward shading them
+bool depthPrepass = false;
+
+// How opaque shapes are lit, set from the command line: --deferred shades them through a G-buffer and light volumes,
+// --visibility through a visibility buffer, and otherwise they are lit with clustered forward shading
+enum ShadingMode
+{
+	SHADING_FORWARD,
+	SHADING_DEFERRED,
+	SHADING_VISIBILITY
+};
+ShadingMode shadingMode = SHADING_FORWARD;
+
 Shader phongShader;
 
 Shader selfIllumShader;
 
-GLuint cubeVAO;
-GLuint cubeVBO;
-GLuint cubeEBO;
-
 B_Spline* teapot;
-Light* lights[3];
+LightHandle lights[3];
 
 GLfloat vertices[] = {
 	-1.0f, +1.0f, -1.0f,
@@ -128,7 +322,7 @@ GLfloat vertices[] = {
 	+1.0f, -1.0f, +1.0f
 };
 
-GLint elements[] = {
+GLuint elements[] = {
 	// Front
 	0, 1, 2,
 	1, 3, 2,
@@ -302,7 +496,7 @@ GLfloat teapotControlPoints[] = {
 
 void generateTeapot()
 {
-	teapot = new B_Spline(phongShader, 28);
+	teapot = MemoryTracker::New<B_Spline>(MEM_PATCHES, phongShader, 28);
 
 	for (int i = 0; i < 28; ++i)
 	{
@@ -330,51 +524,94 @@ void generateTeapot()
 			glm::vec3(teapotControlPoints[k++], teapotControlPoints[k++], teapotControlPoints[k++]));
 	}
 
-	teapot->transform().position = glm::vec3(0.0f, -1.5f, 0.0f);
+	teapot->transform().position(glm::vec3(0.0f, -1.5f, 0.0f));
 }
 
 void SetupLights()
 {
-	LightingManager::Init(phongShader);
-
-	lights[0] = &LightingManager::GetLight(0);
-	lights[0]->angularVelocity = glm::angleAxis(30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-	lights[0]->rotationOrigin = glm::vec3(-3.0f, 1.5f, 0.0f);
-	lights[0]->position = glm::vec3(3.0f, -1.5f, 0.0f);
-	lights[0]->color = glm::vec4(0.8f, 0.0f, 0.0f, 1.0f);
-	lights[0]->power = 5.0f;
+	LightingManager::Init();
+
+	lights[0] = LightingManager::AddLight();
+	Light* light = LightingManager::GetLight(lights[0]);
+	light->angularVelocity = glm::angleAxis(30.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	light->rotationOrigin = glm::vec3(-3.0f, 1.5f, 0.0f);
+	light->position = glm::vec3(3.0f, -1.5f, 0.0f);
+	light->color = glm::vec4(0.8f, 0.0f, 0.0f, 1.0f);
+	light->power = 5.0f;
+	light->castsShadows = true;
 	
-	lights[1] = &LightingManager::GetLight(1);
-	lights[1]->position = glm::vec3(3.0f, 1.0f, 0.0f);
-	lights[1]->color = glm::vec4(0.0f, 0.8f, 0.0f, 1.0f);
-	lights[1]->power = 5.0f;
-
-	lights[2] = &LightingManager::GetLight(2);
-	lights[2]->position = glm::vec3(-3.0f, 1.0f, 0.0f);
-	lights[2]->color = glm::vec4(0.0f, 0.0f, 0.8f, 1.0f);
-	lights[2]->power = 5.0f;
+	lights[1] = LightingManager::AddLight();
+	light = LightingManager::GetLight(lights[1]);
+	light->position = glm::vec3(3.0f, 1.0f, 0.0f);
+	light->color = glm::vec4(0.0f, 0.8f, 0.0f, 1.0f);
+	light->power = 5.0f;
+	light->castsShadows = true;
+
+	lights[2] = LightingManager::AddLight();
+	light = LightingManager::GetLight(lights[2]);
+	light->position = glm::vec3(-3.0f, 1.0f, 0.0f);
+	light->color = glm::vec4(0.0f, 0.0f, 0.8f, 1.0f);
+	light->power = 5.0f;
+	light->castsShadows = true;
+
+	// Dim lights with a short reach scattered around the teapot. Each follows a keyframed loop around the vertical axis at its own
+	// rate, bobbing up and down twice per lap, while its color fades back and forth between two others
+	const unsigned int ORBIT_KEYS = 16;
+	Keyframe orbit[ORBIT_KEYS + 1];
+	Keyframe fade[3];
+	std::vector<LightHandle> allLights(lights, lights + 3);
+	for (unsigned int i = 0; i < extraLights; ++i)
+	{
+		LightHandle handle = LightingManager::AddLight();
+		light = LightingManager::GetLight(handle);
+		if (!light)
+			break;
+
+		float angle = glm::linearRand(0.0f, 360.0f);
+		float distance = glm::linearRand(1.5f, 6.0f);
+		float height = glm::linearRand(-2.0f, 3.0f);
+		float degreesPerSecond = glm::linearRand(10.0f, 45.0f) * (glm::linearRand(0.0f, 1.0f) < 0.5f ? -1.0f : 1.0f);
+		float lapTime = 360.0f / glm::abs(degreesPerSecond);
+		for (unsigned int j = 0; j <= ORBIT_KEYS; ++j)
+		{
+			float lap = (float)j / ORBIT_KEYS;
+			float keyAngle = glm::radians(angle + degreesPerSecond * lapTime * lap);
+			orbit[j].time = lapTime * lap;
+			orbit[j].value = glm::vec4(distance * glm::cos(keyAngle), height + 0.25f * glm::sin(lap * 4.0f * glm::pi<float>()), distance * glm::sin(keyAngle), 0.0f);
+		}
+		AnimationManager::AddTrack(handle, CHANNEL_POSITION, orbit, ORBIT_KEYS + 1);
+
+		float fadeTime = glm::linearRand(2.0f, 6.0f);
+		glm::vec4 color = glm::vec4(glm::linearRand(glm::vec3(0.2f), glm::vec3(1.0f)), 1.0f);
+		fade[0].time = 0.0f;
+		fade[0].value = color;
+		fade[1].time = fadeTime;
+		fade[1].value = glm::vec4(glm::linearRand(glm::vec3(0.2f), glm::vec3(1.0f)), 1.0f);
+		fade[2].time = 2.0f * fadeTime;
+		fade[2].value = color;
+		AnimationManager::AddTrack(handle, CHANNEL_COLOR, fade, 3);
+
+		light->position = glm::vec3(orbit[0].value.x, orbit[0].value.y, orbit[0].value.z);
+		light->color = color;
+		light->power = 0.3f;
+		light->radius = 1.5f;
+		allLights.push_back(handle);
+	}
 
 	LightingManager::SetAmbient(glm::vec3(0.5f, 0.5f, 0.5f));
 
-	// Generate the buffer for the cubes used to show the lights' positions
-	glGenVertexArrays(1, &cubeVAO);
-	glBindVertexArray(cubeVAO);
-	
-	glGenBuffers(1, &cubeVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-
-	glGenBuffers(1, &cubeEBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), &elements, GL_STATIC_DRAW);
-
-	GLint posAttrib = glGetAttribLocation(selfIllumShader.shaderPointer, "position");
-	glEnableVertexAttribArray(posAttrib);
-	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	// Allocate the cube used to show the lights' positions, the light shapes share it and are drawn in one batch
+	GeometryRange cubeRange;
+	GeometryBuffer* cubeGeometry = RenderManager::AllocateGeometry(selfIllumShader, VERTEX_POSITION, 8, 36, cubeRange);
+	cubeGeometry->UploadVerts(cubeRange, vertices);
+	cubeGeometry->UploadElements(cubeRange, elements);
 
-	LightingManager::SetLightShape(new RenderShape(cubeVAO, 36, GL_TRIANGLES, selfIllumShader), 0);
-	LightingManager::SetLightShape(new RenderShape(cubeVAO, 36, GL_TRIANGLES, selfIllumShader), 1);
-	LightingManager::SetLightShape(new RenderShape(cubeVAO, 36, GL_TRIANGLES, selfIllumShader), 2);
+	for (unsigned int i = 0; i < allLights.size(); ++i)
+	{
+		ShapeHandle cube = RenderManager::CreateShape(cubeGeometry->vao(), 36, GL_TRIANGLES, selfIllumShader, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), cubeRange.firstIndex, cubeRange.baseVertex);
+		RenderManager::GetShape(cube)->pass() = PASS_GIZMO;
+		LightingManager::SetLightShape(cube, allLights[i]);
+	}
 }
 
 void initShaders()
@@ -386,11 +623,8 @@ void initShaders()
 
 	phongShader = Shader();
 	phongShader.shaderPointer = phongShaderProgram;
-	phongShader.uModelMat = glGetUniformLocation(phongShaderProgram, "modelMat");
-	phongShader.uViewMat = glGetUniformLocation(phongShaderProgram, "viewMat");
-	phongShader.uProjMat = glGetUniformLocation(phongShaderProgram, "projMat");
-	phongShader.uColor = glGetUniformLocation(phongShaderProgram, "color");
 	phongShader.uCamPos = glGetUniformLocation(phongShaderProgram, "camPos");
+	phongShader.uDrawOffset = glGetUniformLocation(phongShaderProgram, "drawOffset");
 
 	char* si_Shaders[] = { "self_illum_vert.glsl", "self_illum_frag.glsl" };
 	GLenum si_Types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
@@ -400,11 +634,8 @@ void initShaders()
 	selfIllumShader = Shader();
 
 	selfIllumShader.shaderPointer = selfIllumProgram;
-	selfIllumShader.uModelMat = glGetUniformLocation(selfIllumProgram, "modelMat");
-	selfIllumShader.uViewMat = glGetUniformLocation(selfIllumProgram, "viewMat");
-	selfIllumShader.uProjMat = glGetUniformLocation(selfIllumProgram, "projMat");
-	selfIllumShader.uColor = glGetUniformLocation(selfIllumProgram, "color");
 	selfIllumShader.uCamPos = -1;
+	selfIllumShader.uDrawOffset = glGetUniformLocation(selfIllumProgram, "drawOffset");
 }
 
 void init()
@@ -421,7 +652,16 @@ void init()
 
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
-	window = glfwCreateWindow(800, 600, "Geometric_Lighting_Improved-GLFW", NULL, NULL); // Windowed
+	if (benchmark)
+		window = Benchmark::CreateHiddenWindow(800, 600, "Geometric_Lighting_Improved-GLFW"); // Offscreen
+	else
+		window = glfwCreateWindow(800, 600, "Geometric_Lighting_Improved-GLFW", NULL, NULL); // Windowed
+	if (!window)
+	{
+		std::cerr << "Failed to create an OpenGL 4.4 context" << std::endl;
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
 
 	//Activate window
 	glfwMakeContextCurrent(window);
@@ -439,71 +679,340 @@ void init()
 
 	SetupLights();
 
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	LightingManager::SetViewport(framebufferWidth, framebufferHeight);
+	LightingManager::SetLightCutError(lightCutError);
+	ShadowManager::SetTarget(0, framebufferWidth, framebufferHeight);
+	ShadowManager::Init();
+	if (shadingMode == SHADING_DEFERRED)
+	{
+		LightingManager::SetClustered(false);
+		DeferredRenderer::Init(framebufferWidth, framebufferHeight);
+	}
+	else if (shadingMode == SHADING_VISIBILITY)
+	{
+		VisibilityRenderer::Init(framebufferWidth, framebufferHeight);
+	}
+	else
+	{
+		RenderManager::SetShadingLod(shadingLodPixels, framebufferHeight);
+	}
+
 	generateTeapot();
 
 	InputManager::Init(window);
 	CameraManager::Init(800.0f / 600.0f, 60.0f, 0.1f, 100.0f);
 
 	glEnable(GL_DEPTH_TEST);
+
+	FramePacer::Init(window, swapInterval, maxFps);
+	GpuProfiler::Init();
+
+	if (benchmark)
+		Benchmark::Init(benchmarkFrames, 800, 600);
+
+	// Leave one core for the render thread and one for the simulation thread, which takes part in every parallel batch itself
+	unsigned int numCores = std::thread::hardware_concurrency();
+	WorkerPool::Init(numCores > 2 ? numCores - 2 : 0);
+
+	for (unsigned int i = 0; i < NUM_FRAME_PACKETS; ++i)
+	{
+		freePackets.Push(&framePackets[i]);
+	}
+}
+
+// Wakes the thread waiting on condition after a packet was pushed, taking the mutex first so it can't be between its Pop and its wait
+void signalPacket(std::condition_variable& condition)
+{
+	{
+		std::lock_guard<std::mutex> lock(packetMutex);
+	}
+	condition.notify_one();
+}
+
+// Runs on its own thread, updates the scene and records each frame into a packet for the render thread
+void simulate()
+{
+	Profiler::SetThreadName("Simulation");
+
+	float stepTime = 1.0f / simulationRate;
+	float accumulator = 0.0f;
+	double lastTime = glfwGetTime();
+	unsigned int frame = 0;
+	while (running)
+	{
+		PROFILE_ZONE("Simulation frame");
+
+		InputManager::Update();
+
+		// P starts a profiling capture and pressing it again writes it out
+		if (InputManager::pKey() && !InputManager::pKey(true))
+		{
+			if (!Profiler::capturing())
+				Profiler::StartCapture();
+			else if (Profiler::StopCapture("trace.json"))
+				std::cout << "Profiler capture written to trace.json" << std::endl;
+		}
+
+		if (InputManager::mKey() && !InputManager::mKey(true))
+			MemoryTracker::LogReport();
+
+		// Get time passed since the last frame, benchmarks advance exactly one step per frame so every run simulates the same thing
+		double time = glfwGetTime();
+		accumulator += Benchmark::active() ? stepTime : (float)(time - lastTime);
+		lastTime = time;
+		accumulator = accumulator > MAX_SIMULATION_STEPS * stepTime ? MAX_SIMULATION_STEPS * stepTime : accumulator;
+
+		if (Benchmark::active())
+			Benchmark::ScriptCamera(frame);
+		++frame;
+
+		float dTheta = 45.0f * InputManager::rightKey();
+		dTheta -= 45.0f * InputManager::leftKey();
+
+		teapot->transform().angularVelocity(glm::angleAxis(dTheta, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+		// The camera follows the mouse directly rather than over time, so it moves once per frame
+		CameraManager::Update(stepTime);
+
+		while (accumulator >= stepTime)
+		{
+			PROFILE_ZONE("Simulation step");
+
+			TransformManager::BeginStep();
+
+			AnimationManager::Update(stepTime);
+
+			RenderManager::Update(stepTime);
+
+			LightingManager::Update(stepTime);
+
+			teapot->Update(stepTime);
+
+			TransformManager::Update(stepTime);
+
+			accumulator -= stepTime;
+		}
+
+		// How far the current time is between the last step and the next
+		float alpha = accumulator / stepTime;
+		TransformManager::Interpolate(alpha);
+
+		// Wait for the render thread to finish with a packet
+		FramePacket* packet;
+		{
+			PROFILE_ZONE("Wait for free packet");
+			std::unique_lock<std::mutex> lock(packetMutex);
+			packetFreed.wait(lock, [&packet]() { return !running || freePackets.Pop(packet); });
+			if (!running)
+				return;
+		}
+
+		RenderManager::BuildFrame(*packet);
+		LightingManager::BuildFrame(*packet, alpha);
+		ShadowManager::BuildFrame(*packet);
+		packet->patchesRetessellated = Patch::TakeSurfaceUpdates();
+
+		// Cannot fail, there are only as many packets as the queue holds
+		filledPackets.Push(packet);
+		signalPacket(packetFilled);
+	}
 }
 
+// Runs on the main thread, which owns the GL context, and only submits packets produced by the simulation
 void step()
 {
-	// Clear to black
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	
-	InputManager::Update();
+	FramePacket* packet;
+	{
+		// If the next frame is not ready in time, go back to polling events
+		std::unique_lock<std::mutex> lock(packetMutex);
+		if (!packetFilled.wait_for(lock, MAX_PACKET_WAIT, [&packet]() { return filledPackets.Pop(packet); }))
+			return;
+	}
 
-	// Get delta time since the last frame
-	float dt = glfwGetTime();
-	glfwSetTime(0.0);
+	PROFILE_ZONE("Render frame");
 
-	float dTheta = 45.0f * InputManager::rightKey();
-	dTheta -= 45.0f * InputManager::leftKey();
+	FramePacer::BeginFrame();
+	GpuProfiler::BeginFrame();
+	RenderManager::BeginFrame();
 
-	teapot->transform().angularVelocity = glm::angleAxis(dTheta, glm::vec3(0.0f, 1.0f, 0.0f));
+	// Clear to black
+	GpuProfiler::BeginPass("clear");
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	GpuProfiler::EndPass();
 
-	CameraManager::Update(dt);
+	LightingManager::Apply(*packet);
 
-	RenderManager::Update(dt);
+	RenderManager::Upload(*packet);
+	ShadowManager::Render(*packet);
+	switch (shadingMode)
+	{
+	case SHADING_DEFERRED:
+		DeferredRenderer::DrawOpaque(*packet);
+		break;
+	case SHADING_VISIBILITY:
+		VisibilityRenderer::DrawOpaque(*packet);
+		break;
+	default:
+		// After the prepass depth holds the nearest opaque surface, so the lit pass only shades fragments landing exactly on it
+		if (depthPrepass)
+		{
+			RenderManager::DrawDepth(*packet, PASS_OPAQUE);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
+		RenderManager::DrawPass(*packet, PASS_OPAQUE, LightingManager::ForwardShader(), LightingManager::VertexLitShader);
+		if (depthPrepass)
+		{
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+		break;
+	}
+	RenderManager::DrawPass(*packet, PASS_GIZMO);
+	RenderManager::EndFrame();
 
-	LightingManager::Update(dt);
+	GpuProfiler::EndFrame();
 
-	teapot->Update(dt);
+	// Everything in the packet has been copied into GL by now, so the simulation can start refilling it
+	freePackets.Push(packet);
+	signalPacket(packetFreed);
 
-	RenderManager::Draw();
+	// Swap buffers, then hold the frame back if it is ahead of the frame rate cap
+	FramePacer::Present();
 
-	// Swap buffers
-	glfwSwapBuffers(window);
+	if (Benchmark::active())
+		Benchmark::EndFrame(RenderManager::stats());
 }
 
-void cleanUp()
+// Returns false if the benchmark report could not be written
+bool cleanUp()
 {
+	bool reported = true;
+	if (Benchmark::active())
+	{
+		if (benchmarkOutput)
+		{
+			std::ofstream report(benchmarkOutput);
+			if (report)
+			{
+				Benchmark::WriteReport(report);
+				report.close();
+			}
+			if (!report)
+			{
+				std::cerr << "Could not write the benchmark report to " << benchmarkOutput << std::endl;
+				reported = false;
+			}
+		}
+		else
+		{
+			Benchmark::WriteReport(std::cout);
+		}
+		Benchmark::Shutdown();
+	}
+
+	GpuProfiler::Shutdown();
+
 	glDeleteProgram(phongShader.shaderPointer);
 	glDeleteProgram(selfIllumShader.shaderPointer);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteBuffers(1, &cubeEBO);
-	glDeleteVertexArrays(1, &cubeVAO);
+
+	if (shadingMode == SHADING_DEFERRED)
+		DeferredRenderer::DumpData();
+	else if (shadingMode == SHADING_VISIBILITY)
+		VisibilityRenderer::DumpData();
+
+	MemoryTracker::Delete(MEM_PATCHES, teapot);
+
+	ShadowManager::DumpData();
+
+	AnimationManager::DumpData();
+
+	LightingManager::DumpData();
 
 	RenderManager::DumpData();
 
-	delete teapot;
+	TransformManager::DumpData();
+
+	WorkerPool::Shutdown();
+
+	FramePacer::Shutdown();
+
+	Profiler::Shutdown();
+
+	// Packets are only handed back and forth, their storage lives until now
+	for (unsigned int i = 0; i < NUM_FRAME_PACKETS; ++i)
+	{
+		framePackets[i] = FramePacket();
+	}
+
+	MemoryTracker::Shutdown();
 
 	glfwTerminate();
+	return reported;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0)
+			benchmark = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			char* end;
+			long frames = strtol(argv[++i], &end, 10);
+			if (*end != '\0' || frames <= 0)
+			{
+				std::cerr << "--frames needs a whole number of frames above 0, got " << argv[i] << std::endl;
+				return EXIT_FAILURE;
+			}
+			benchmarkFrames = (unsigned int)frames;
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			benchmarkOutput = argv[++i];
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			extraLights = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--light-error") == 0 && i + 1 < argc)
+			lightCutError = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--shading-lod") == 0 && i + 1 < argc)
+			shadingLodPixels = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+		else if (strcmp(argv[i], "--deferred") == 0)
+			shadingMode = SHADING_DEFERRED;
+		else if (strcmp(argv[i], "--visibility") == 0)
+			shadingMode = SHADING_VISIBILITY;
+		else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+		{
+			simulationRate = (float)atof(argv[++i]);
+			if (simulationRate <= 0.0f)
+			{
+				std::cerr << "--sim-rate needs a number of steps per second above 0, got " << argv[i] << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
 	init();
 
-	while (!glfwWindowShouldClose(window))
+	Profiler::SetThreadName("Render");
+
+	running = true;
+	std::thread simThread(simulate);
+
+	while (!glfwWindowShouldClose(window) && !(Benchmark::active() && Benchmark::finished()))
 	{
-		step();
 		glfwPollEvents();
+		InputManager::Poll();
+		step();
 	}
 
-	cleanUp();
+	running = false;
+	signalPacket(packetFreed);
+	simThread.join();
 
-	return 0;
+	return cleanUp() ? 0 : EXIT_FAILURE;
 }
@@ -1,16 +1,17 @@
 #version 440
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "draw_data.glsl"
 
 in vec3 position;
 
-uniform mat4 modelMat;
-uniform mat4 viewMat;
-uniform mat4 projMat;
-uniform vec4 color;
+uniform int drawOffset;
 
 out vec4 Color;
 
 void main()
 {
-	Color = color;
-	gl_Position = projMat * viewMat * modelMat * vec4(position.xyz, 1.0);
+	DrawData draw = draws[drawOffset + gl_DrawIDARB];
+	Color = draw.color;
+	gl_Position = draw.mvpMat * vec4(position.xyz, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 440
+
+// Position in xyz and radius in w of the light the cube belongs to
+uniform vec4 light;
+
+in vec3 WorldPos;
+
+void main()
+{
+	// Distance from the light over its radius rather than projected depth, so every face of the cube stores the same measure
+	// and the lighting shaders can compare against it without knowing which face they sample
+	gl_FragDepth = distance(WorldPos, light.xyz) / light.w;
+}
\ No newline at end of file
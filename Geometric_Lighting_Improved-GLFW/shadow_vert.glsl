@@ -0,0 +1,21 @@
+#version 440
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "draw_data.glsl"
+
+// Matches the forward shader's locations so shadow casters are drawn from their own vertex arrays
+layout(location = 0) in vec3 position;
+
+uniform int drawOffset;
+// Projection and view of the cube face being drawn
+uniform mat4 viewProjMat;
+
+out vec3 WorldPos;
+
+void main()
+{
+	DrawData draw = draws[drawOffset + gl_DrawIDARB];
+	vec4 worldPos = draw.modelMat * vec4(position.xyz, 1.0);
+	WorldPos = worldPos.xyz;
+	gl_Position = viewProjMat * worldPos;
+}
\ No newline at end of file
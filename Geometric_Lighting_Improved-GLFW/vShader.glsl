@@ -1,24 +1,42 @@
 #version 440
+#extension GL_ARB_shader_draw_parameters : require
 
-in vec3 position;
-in vec3 normal;
+#include "draw_data.glsl"
+#ifdef PER_VERTEX_LIGHTING
+#include "lighting.glsl"
+#endif
 
-uniform mat4 modelMat;
-uniform mat4 viewMat;
-uniform mat4 projMat;
-uniform vec4 color;
-uniform vec4 camPos;
+// Fixed locations, so the G-buffer shader built from this file reads the same vertex arrays as the forward one
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+uniform int drawOffset;
 
 out vec4 Color;
 out vec4 Normal;
 out vec4 WorldPos;
-out vec4 CamPos;
+flat out uvec2 ObjectLights;
+// The depth prepass in depth_vert.glsl must land on exactly the same depths
+invariant gl_Position;
 
 void main()
 {
-	Color = color;
-	Normal =  transpose(inverse(modelMat)) * vec4(normal.xyz, 0.0);
-	WorldPos = modelMat * vec4(position.xyz, 1.0);
-	CamPos = camPos;
-	gl_Position = projMat * viewMat * modelMat * vec4(position.xyz, 1.0);
+	DrawData draw = draws[drawOffset + gl_DrawIDARB];
+	Color = draw.color;
+	ObjectLights = draw.lightRange;
+	// The normal matrix and combined model-view-projection matrix are computed once per draw on the CPU
+	Normal = vec4(draw.normalMat * normal, 0.0);
+	WorldPos = draw.modelMat * vec4(position.xyz, 1.0);
+	gl_Position = draw.mvpMat * vec4(position.xyz, 1.0);
+
+#ifdef PER_VERTEX_LIGHTING
+	// Defined by LightingManager for shapes too small on screen for per pixel lighting to show. Vertices have no cluster and
+	// may lie off screen, so they use the shape's own lights, which RenderManager only lights this way for shapes with bounds
+	Normal = normalize(Normal);
+#ifdef NUM_LIGHTS
+	Color = ShadeAll(WorldPos, Normal, draw.color);
+#else
+	Color = ShadeObject(WorldPos, Normal, draw.color, draw.lightRange);
+#endif
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 440
+
+flat in uint DrawIndex;
+
+layout(location = 0) out uvec2 outVisibility;
+
+void main()
+{
+	// The draw is offset by one so a cleared pixel reads as empty, gl_PrimitiveID restarts at 0 for every draw of a multi-draw
+	outVisibility = uvec2(DrawIndex + 1u, uint(gl_PrimitiveID));
+};
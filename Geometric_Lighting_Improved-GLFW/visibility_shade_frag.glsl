@@ -0,0 +1,90 @@
+#version 440
+
+#include "lighting.glsl"
+#include "draw_data.glsl"
+
+// Matches DrawElementsIndirectCommand in RenderManager.h
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 4) readonly buffer CommandBuffer
+{
+	DrawCommand commands[];
+};
+
+// Vertex and element storage of the GeometryBuffer being shaded, vertices are a position followed by a normal
+layout(std430, binding = 5) readonly buffer VertexBuffer
+{
+	float vertexData[];
+};
+
+layout(std430, binding = 6) readonly buffer ElementBuffer
+{
+	uint elementData[];
+};
+
+layout(binding = 0) uniform usampler2D visibilityTexture;
+
+uniform mat4 viewMat;
+uniform mat4 invViewProjMat;
+uniform vec2 invViewport;
+// Draws in [x, y) all read the bound vertex and element buffers, pixels of any other draw are left to another pass
+uniform uvec2 drawRange;
+
+out vec4 outColor;
+
+uint VertexIndex(DrawCommand command, uint element)
+{
+	return uint(int(elementData[command.firstIndex + element]) + command.baseVertex);
+}
+
+vec3 VertexPosition(uint vertex)
+{
+	return vec3(vertexData[vertex * 6u], vertexData[vertex * 6u + 1u], vertexData[vertex * 6u + 2u]);
+}
+
+vec3 VertexNormal(uint vertex)
+{
+	return vec3(vertexData[vertex * 6u + 3u], vertexData[vertex * 6u + 4u], vertexData[vertex * 6u + 5u]);
+}
+
+void main()
+{
+	uvec2 visibility = texelFetch(visibilityTexture, ivec2(gl_FragCoord.xy), 0).xy;
+	uint drawIndex = visibility.x - 1u;
+	if (visibility.x == 0u || drawIndex < drawRange.x || drawIndex >= drawRange.y)
+		discard;
+
+	DrawData draw = draws[drawIndex];
+	DrawCommand command = commands[drawIndex];
+	uint i0 = VertexIndex(command, visibility.y * 3u);
+	uint i1 = VertexIndex(command, visibility.y * 3u + 1u);
+	uint i2 = VertexIndex(command, visibility.y * 3u + 2u);
+
+	vec3 p0 = (draw.modelMat * vec4(VertexPosition(i0), 1.0)).xyz;
+	vec3 e1 = (draw.modelMat * vec4(VertexPosition(i1), 1.0)).xyz - p0;
+	vec3 e2 = (draw.modelMat * vec4(VertexPosition(i2), 1.0)).xyz - p0;
+
+	// Barycentrics of where the pixel's view ray meets the triangle's plane. Unlike interpolating in screen space this is
+	// perspective correct without any divide by w, so it holds for triangles reaching behind the camera
+	vec4 farPoint = invViewProjMat * vec4(gl_FragCoord.xy * invViewport * 2.0 - 1.0, 1.0, 1.0);
+	vec3 rayDir = farPoint.xyz / farPoint.w - camPos.xyz;
+	vec3 rayToP0 = camPos.xyz - p0;
+	vec3 pVec = cross(rayDir, e2);
+	float invDet = 1.0 / dot(e1, pVec);
+	float u = dot(rayToP0, pVec) * invDet;
+	float v = dot(rayDir, cross(rayToP0, e1)) * invDet;
+
+	vec4 WorldPos = vec4(p0 + u * e1 + v * e2, 1.0);
+	vec3 normal = VertexNormal(i0) * (1.0 - u - v) + VertexNormal(i1) * u + VertexNormal(i2) * v;
+	vec4 Normal = vec4(draw.normalMat * normal, 0.0);
+
+	float viewDepth = -(viewMat * WorldPos).z;
+	outColor = ShadeCulled(WorldPos, Normal, draw.color, ClusterIndex(gl_FragCoord.xy, viewDepth), draw.lightRange);
+};
@@ -0,0 +1,17 @@
+#version 440
+#extension GL_ARB_shader_draw_parameters : require
+
+#include "draw_data.glsl"
+
+// Same location as vShader.glsl, so the opaque shapes' vertex arrays can be drawn with it
+layout(location = 0) in vec3 position;
+
+uniform int drawOffset;
+
+flat out uint DrawIndex;
+
+void main()
+{
+	DrawIndex = uint(drawOffset + gl_DrawIDARB);
+	gl_Position = draws[DrawIndex].mvpMat * vec4(position.xyz, 1.0);
+};